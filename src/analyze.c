@@ -0,0 +1,249 @@
+
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include "analyze.h"
+#include "board.h"
+#include "engine.h"
+#include "move.h"
+#include "numa.h"
+#include "search.h"
+#include "thread.h"
+#include "transposition.h"
+#include "types.h"
+#include "util.h"
+
+typedef struct {
+  char** lines;
+  int count, next, done;
+  int depth, movetime;
+  int workers;
+
+  FILE* out;
+  pthread_mutex_t mutex; // guards out and the totals
+  uint64_t nodes;
+} Batch;
+
+typedef struct {
+  Batch* batch;
+  ThreadData* thread; // a pool of one, so every search is independent, bound as thread w
+} AnalyzeWorker;
+
+// one line of output per position: the input line with the analysis opcodes appended,
+// the score from the side to move and the pv in uci notation
+void WriteAnalysis(Batch* batch, char* line, ThreadData* thread, Board* board) {
+  int score = thread->completedScore;
+  uint64_t nodes = thread->data.nodes;
+
+  pthread_mutex_lock(&batch->mutex);
+
+  fprintf(batch->out, "%s acd %d; acn %" PRIu64 ";", line, thread->completedDepth, nodes);
+  if (score >= MATE_BOUND)
+    fprintf(batch->out, " dm %d;", (CHECKMATE - score + 1) / 2);
+  else if (score <= -MATE_BOUND)
+    fprintf(batch->out, " dm %d;", -(CHECKMATE + score) / 2);
+  else
+    fprintf(batch->out, " ce %d;", score);
+
+  if (thread->completedPv.count) {
+    fprintf(batch->out, " pv");
+    for (int i = 0; i < thread->completedPv.count; i++)
+      fprintf(batch->out, " %s", MoveToStr(thread->completedPv.moves[i], board));
+    fprintf(batch->out, ";");
+  }
+
+  fprintf(batch->out, "\n");
+  fflush(batch->out);
+
+  batch->nodes += nodes;
+  batch->done++;
+  if (batch->done % max(1, batch->count / 100) == 0 || batch->done == batch->count)
+    printf("info string analyzed %d of %d\n", batch->done, batch->count);
+
+  pthread_mutex_unlock(&batch->mutex);
+}
+
+// a worker takes the next position until there are none left
+void* AnalyzePositions(void* arg) {
+  AnalyzeWorker* worker = (AnalyzeWorker*)arg;
+  Batch* batch = worker->batch;
+  ThreadData* thread = worker->thread;
+  Board board;
+
+  int i;
+  while ((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < batch->count) {
+    ParseFen(batch->lines[i], &board);
+
+    // the table ages once per round of positions the workers have in flight together, aged
+    // per position a search still running would see its own entries go stale
+    if (i % batch->workers == 0)
+      TTUpdate(&thread->engine->tt);
+
+    SearchParams params = {.depth = batch->depth, .multiPV = 1, .quiet = 1};
+    if (batch->movetime > 0) {
+      params.depth = MAX_SEARCH_PLY - 1;
+      params.timeset = 1;
+      params.softLimit = params.hardLimit = batch->movetime;
+    }
+
+    SearchResults results = {0};
+    ResetThreadPool(thread);
+    InitPool(&board, &params, thread, &results);
+
+    params.start = GetTimeMS();
+    Search(thread);
+
+    WriteAnalysis(batch, batch->lines[i], thread, &board);
+  }
+
+  return NULL;
+}
+
+// ParseFen trusts its input, so a line it would misread is skipped instead. The piece
+// placement has to be 8 ranks of 8 squares with one king a side and no pawns on the back
+// ranks, followed by the side to move, castling (standard or by rook file) and en passant.
+int ValidFen(char* fen) {
+  int rank = 0, file = 0, whiteKings = 0, blackKings = 0;
+
+  for (; *fen && *fen != ' '; fen++) {
+    if (*fen == '/') {
+      if (file != 8 || ++rank > 7)
+        return 0;
+      file = 0;
+    } else if (*fen >= '1' && *fen <= '8') {
+      file += *fen - '0';
+    } else if (strchr("PNBRQKpnbrqk", *fen)) {
+      if ((*fen == 'P' || *fen == 'p') && (rank == 0 || rank == 7))
+        return 0;
+      whiteKings += *fen == 'K';
+      blackKings += *fen == 'k';
+      file++;
+    } else {
+      return 0;
+    }
+
+    if (file > 8)
+      return 0;
+  }
+
+  if (rank != 7 || file != 8 || whiteKings != 1 || blackKings != 1)
+    return 0;
+
+  if (*fen++ != ' ' || (*fen != 'w' && *fen != 'b') || fen[1] != ' ')
+    return 0;
+  fen += 2;
+
+  char* castling = fen;
+  if (*fen == '-')
+    fen++;
+  else
+    while (*fen && fen - castling < 4 && strchr("KQkqABCDEFGHabcdefgh", *fen))
+      fen++;
+
+  if (fen == castling || *fen++ != ' ')
+    return 0;
+
+  if (*fen == '-')
+    fen++;
+  else if (*fen >= 'a' && *fen <= 'h' && (fen[1] == '3' || fen[1] == '6'))
+    fen += 2;
+  else
+    return 0;
+
+  return !*fen || *fen == ' ';
+}
+
+// Batch analysis of an EPD (or FEN) file: workers run independent single threaded
+// searches on the positions concurrently, sharing the TT, and the results stream
+// to out in the order they finish
+void Analyze(char* path, char* out, int workers, int hash, int depth, int movetime) {
+  FILE* fp = fopen(path, "r");
+  if (!fp) {
+    printf("info string unable to open %s\n", path);
+    return;
+  }
+
+  Batch batch = {.depth = depth, .movetime = movetime};
+  int capacity = 0, lineNumber = 0;
+  char line[8192];
+
+  while (fgets(line, sizeof(line), fp)) {
+    lineNumber++;
+    size_t length = strlen(line);
+    while (length && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' '))
+      line[--length] = '\0';
+
+    if (!length || line[0] == '#')
+      continue;
+
+    if (!ValidFen(line)) {
+      printf("info string skipping line %d of %s, not a position: %.80s\n", lineNumber, path, line);
+      continue;
+    }
+
+    if (batch.count == capacity) {
+      capacity = max(1024, 2 * capacity);
+      batch.lines = realloc(batch.lines, capacity * sizeof(char*));
+    }
+    batch.lines[batch.count++] = strdup(line);
+  }
+  fclose(fp);
+
+  char outPath[1024];
+  if (!out) {
+    snprintf(outPath, sizeof(outPath), "%s.out", path);
+    out = outPath;
+  }
+
+  if (!(batch.out = fopen(out, "w"))) {
+    printf("info string unable to open %s\n", out);
+    return;
+  }
+
+  if (workers < 1) {
+    workers = 1;
+#if !defined(_WIN32)
+    workers = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  }
+  workers = max(1, min(workers, batch.count));
+  batch.workers = workers;
+
+  // the workers search in pools of their own, sharing this engine's table
+  NumaSetThreads(workers);
+  Engine* engine = CreateEngine(hash > 0 ? min(TT_MAX_MB, hash) : 32, 1);
+
+  printf("info string analyzing %d positions with %d workers to %s\n", batch.count, workers, out);
+  pthread_mutex_init(&batch.mutex, NULL);
+  AnalyzeWorker* pool = calloc(workers, sizeof(AnalyzeWorker));
+
+  long start = GetTimeMS();
+  for (int w = 0; w < workers; w++) {
+    pool[w] = (AnalyzeWorker){.batch = &batch, .thread = CreatePool(engine, 1, w)};
+    StartJob(pool[w].thread, &AnalyzePositions, &pool[w]);
+  }
+
+  for (int w = 0; w < workers; w++) {
+    WaitJob(pool[w].thread);
+    DestroyPool(pool[w].thread);
+  }
+  long time = GetTimeMS() - start;
+
+  printf("Analyzed: %42d positions %8ld ms\n", batch.count, time);
+  printf("Results: %43" PRIu64 " nodes %8d nps\n", batch.nodes, (int)(1000.0 * batch.nodes / (time + 1)));
+
+  DestroyEngine(engine);
+  fclose(batch.out);
+  pthread_mutex_destroy(&batch.mutex);
+  for (int i = 0; i < batch.count; i++)
+    free(batch.lines[i]);
+  free(batch.lines);
+  free(pool);
+}
@@ -0,0 +1,8 @@
+
+
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+void Analyze(char* path, char* out, int workers, int hash, int depth, int movetime);
+
+#endif
@@ -1,12 +1,20 @@
 
 
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
 
 #include "bench.h"
 #include "board.h"
+#include "engine.h"
 #include "move.h"
+#include "numa.h"
 #include "search.h"
 #include "thread.h"
 #include "transposition.h"
@@ -65,48 +73,213 @@ char* benchmarks[] = {"r3k2r/2pb1ppp/2pp1q2/p7/1nP1B3/1P2P3/P2N1PPP/R2QK2R w KQk
                       "3br1k1/p1pn3p/1p3n2/5pNq/2P1p3/1PN3PP/P2Q1PB1/4R1K1 w - - 0 23",
                       "2r2b2/5p2/5k2/p1r1pP2/P2pB3/1P3P2/K1P3R1/7R w - - 23 93"};
 
-const int NUM_BENCH_POSITIONS = 50;
+#define NUM_BENCH_POSITIONS 50
 
-void Bench() {
-  Board board;
-  SearchParams params = {.depth = 13, .multiPV = 1};
-  ThreadData* threads = CreatePool(1);
+#define STARTUP_THREADS 8
+#define STARTUP_ROUNDS 1000
+
+void* NoSearch(void* arg) { return arg; }
+
+// Per search cost of getting the helpers running and back, by spawning and joining
+// them the way searches used to and by waking the sleeping pool
+void StartupLatency() {
+  ThreadData* threads = CreatePool(NULL, STARTUP_THREADS, 0);
+  pthread_t pthreads[STARTUP_THREADS];
 
+  long start = GetTimeMS();
+  for (int r = 0; r < STARTUP_ROUNDS; r++) {
+    for (int i = 1; i < STARTUP_THREADS; i++)
+      pthread_create(&pthreads[i], NULL, &NoSearch, &threads[i]);
+    for (int i = 1; i < STARTUP_THREADS; i++)
+      pthread_join(pthreads[i], NULL);
+  }
+  long created = GetTimeMS() - start;
+
+  start = GetTimeMS();
+  for (int r = 0; r < STARTUP_ROUNDS; r++) {
+    StartHelpers(threads, &NoSearch);
+    WaitHelpers(threads);
+  }
+  long pooled = GetTimeMS() - start;
+
+  printf("Startup: %43.1f us spawn %8.1f us pool %3d threads\n\n", 1000.0 * created / STARTUP_ROUNDS,
+         1000.0 * pooled / STARTUP_ROUNDS, STARTUP_THREADS);
+
+  DestroyPool(threads);
+}
+
+typedef struct {
   Move bestMoves[NUM_BENCH_POSITIONS];
   int scores[NUM_BENCH_POSITIONS];
-  int nodes[NUM_BENCH_POSITIONS];
+  uint64_t nodes[NUM_BENCH_POSITIONS];
   long times[NUM_BENCH_POSITIONS];
 
+  uint64_t totalNodes;
+  long totalTime, clearTime;
+#ifdef TT_STATS
+  TTStats ttStats;
+#endif
+} BenchRun;
+
+// search the first count bench positions to depth, or for movetime ms when it is set,
+// each from a cleared table
+void RunBench(Engine* engine, int count, int depth, int movetime, BenchRun* run) {
+  ThreadData* threads = engine->threads;
+  Board board;
+  memset(run, 0, sizeof(BenchRun));
+
   long startTime = GetTimeMS();
-  for (int i = 0; i < NUM_BENCH_POSITIONS; i++) {
+  for (int i = 0; i < count; i++) {
     ParseFen(benchmarks[i], &board);
 
+    SearchParams params = {.depth = depth, .multiPV = 1};
+    if (movetime > 0) {
+      params.depth = MAX_SEARCH_PLY - 1;
+      params.timeset = 1;
+      params.softLimit = params.hardLimit = movetime;
+    }
+
     SearchResults results = {0};
-    TTClear();
+    long clearStart = GetTimeMS();
+    TTClear(&engine->tt, threads);
+    run->clearTime += GetTimeMS() - clearStart;
+
     ResetThreadPool(threads);
-    InitPool(&board, &params, threads, &results);
 
     params.start = GetTimeMS();
     BestMove(&board, &params, threads, &results);
-    times[i] = GetTimeMS() - params.start;
+    run->times[i] = GetTimeMS() - params.start;
+
+    run->bestMoves[i] = results.bestMove;
+    run->scores[i] = results.score;
+    run->nodes[i] = NodesSearched(threads);
+    run->totalNodes += run->nodes[i];
+
+#ifdef TT_STATS
+    for (int t = 0; t < threads->count; t++)
+      TTAddStats(&run->ttStats, &threads[t].ttStats);
+#endif
+  }
+
+  // the clears are reported on their own and kept out of the nps
+  run->totalTime = GetTimeMS() - startTime - run->clearTime;
+}
+
+INLINE double Nps(uint64_t nodes, long time) { return 1000.0 * nodes / (time + 1); }
+
+// bench [threads=N] [hash=MB] [depth=D] [movetime=MS]
+// With more than one thread the set is also searched single threaded, to report the
+// time to depth speedup (per position as well, it varies a lot) and the nps scaling.
+void Bench(int threadCount, int hash, int depth, int movetime) {
+  Board board;
+  BenchRun run;
+
+  threadCount = max(1, threadCount);
+  NumaSetThreads(threadCount);
+  Engine* engine = CreateEngine(hash > 0 ? hash : 32, threadCount);
+  RunBench(engine, NUM_BENCH_POSITIONS, depth, movetime, &run);
 
-    bestMoves[i] = results.bestMoves[results.depth];
-    scores[i] = results.scores[results.depth];
-    nodes[i] = threads[0].data.nodes;
+  BenchRun base;
+  if (threadCount > 1) {
+    SetThreads(engine, 1);
+    RunBench(engine, NUM_BENCH_POSITIONS, depth, movetime, &base);
   }
-  long totalTime = GetTimeMS() - startTime;
+  DestroyEngine(engine);
 
   printf("\n\n");
   for (int i = 0; i < NUM_BENCH_POSITIONS; i++) {
-    printf("Bench [#%2d]: bestmove %5s score %5d %12d nodes %8d nps | %71s\n", i + 1, MoveToStr(bestMoves[i], &board),
-           scores[i], nodes[i], (int)(1000.0 * nodes[i] / (times[i] + 1)), benchmarks[i]);
+    ParseFen(benchmarks[i], &board);
+    printf("Bench [#%2d]: bestmove %5s score %5d %12" PRIu64 " nodes %8d nps | %71s\n", i + 1,
+           MoveToStr(run.bestMoves[i], &board), run.scores[i], run.nodes[i], (int)Nps(run.nodes[i], run.times[i]),
+           benchmarks[i]);
   }
 
-  int totalNodes = 0;
+  // spread of the per position nps, a high one means the total hides slow positions
+  double mean = 0, variance = 0;
   for (int i = 0; i < NUM_BENCH_POSITIONS; i++)
-    totalNodes += nodes[i];
+    mean += Nps(run.nodes[i], run.times[i]) / NUM_BENCH_POSITIONS;
+  for (int i = 0; i < NUM_BENCH_POSITIONS; i++)
+    variance += pow(Nps(run.nodes[i], run.times[i]) - mean, 2) / NUM_BENCH_POSITIONS;
+
+  printf("\nResults: %43" PRIu64 " nodes %8d nps\n", run.totalNodes, (int)Nps(run.totalNodes, run.totalTime));
+  printf("NPS per position: %34d mean %7.1f%% stddev\n", (int)mean, 100 * sqrt(variance) / (mean + 1));
+  printf("TT Clear: %42ld ms %8d threads\n", run.clearTime, threadCount);
+
+  if (threadCount > 1) {
+    double baseNps = Nps(base.totalNodes, base.totalTime);
+    double speedup = Nps(run.totalNodes, run.totalTime) / baseNps;
+
+    printf("1 thread: %42" PRIu64 " nodes %8d nps\n", base.totalNodes, (int)baseNps);
+    printf("NPS scaling: %39.2fx speedup %5.1f%% efficiency\n", speedup, 100 * speedup / threadCount);
+
+    // a fixed time says nothing about time to depth
+    if (movetime <= 0) {
+      double ttdMean = 0, ttdVariance = 0;
+      for (int i = 0; i < NUM_BENCH_POSITIONS; i++)
+        ttdMean += (base.times[i] + 1.0) / (run.times[i] + 1) / NUM_BENCH_POSITIONS;
+      for (int i = 0; i < NUM_BENCH_POSITIONS; i++)
+        ttdVariance += pow((base.times[i] + 1.0) / (run.times[i] + 1) - ttdMean, 2) / NUM_BENCH_POSITIONS;
+
+      printf("Time to depth: %37.2fx speedup %5.2f stddev per position (mean %.2fx)\n",
+             (base.totalTime + 1.0) / (run.totalTime + 1), sqrt(ttdVariance), ttdMean);
+    }
+  }
+
+#ifdef TT_STATS
+  TTPrintStats(&run.ttStats, "bench");
+  printf("\n");
+#endif
+}
 
-  printf("\nResults: %43d nodes %8d nps\n\n", totalNodes, (int)(1000.0 * totalNodes / (totalTime + 1)));
+#define SCALE_POSITIONS 8
+
+// Thread scaling: the first few bench positions searched with 1, 2, 4, ... threads
+// up to maxThreads, for a fixed time to compare nodes per second and to a fixed
+// to depth to compare time to depth (the speedup Lazy SMP actually delivers), and
+// what starting the helpers costs per search
+void BenchScaling(int maxThreads, int ms, int depth) {
+  int cpus = 0;
+#if !defined(_WIN32)
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  // 1/2/4/8/16/32 by default, the rows past the cpu count show oversubscription
+  if (maxThreads < 1)
+    maxThreads = 32;
+
+  BenchRun run;
+  int counts[16], n = 0;
+  double nps[16];
+  long ttd[16];
+
+  for (int t = 1; t < maxThreads && n < 15; t *= 2)
+    counts[n++] = t;
+  counts[n++] = maxThreads;
+
+  Engine* engine = CreateEngine(32, 1);
+  for (int c = 0; c < n; c++) {
+    SetThreads(engine, counts[c]);
+
+    RunBench(engine, SCALE_POSITIONS, 0, ms, &run);
+    nps[c] = Nps(run.totalNodes, run.totalTime);
+
+    ttd[c] = 0;
+    if (depth > 0) {
+      RunBench(engine, SCALE_POSITIONS, depth, 0, &run);
+      ttd[c] = run.totalTime;
+    }
+  }
+  DestroyEngine(engine);
+
+  printf("\n\n");
+  for (int c = 0; c < n; c++) {
+    printf("Threads %3d: %12d nps %6.2fx speedup %5.1f%% efficiency", counts[c], (int)nps[c], nps[c] / nps[0],
+           100 * nps[c] / nps[0] / counts[c]);
+    if (depth > 0)
+      printf(" %8ld ms to depth %-3d %6.2fx speedup", ttd[c], depth, (double)(ttd[0] + 1) / (ttd[c] + 1));
+    printf("\n");
+  }
+  printf("CPUs: %45d\n", cpus);
+  printf("NUMA nodes: %39d\n", NumaNodes());
 
-  free(threads);
-}
\ No newline at end of file
+  StartupLatency();
+}
@@ -3,6 +3,7 @@
 #ifndef BENCH_H
 #define BENCH_H
 
-void Bench();
+void Bench(int threads, int hash, int depth, int movetime);
+void BenchScaling(int maxThreads, int ms, int depth);
 
 #endif
\ No newline at end of file
@@ -1,12 +1,16 @@
 
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "analyze.h"
 #include "attacks.h"
 #include "bench.h"
 #include "bits.h"
 #include "board.h"
 #include "eval.h"
+#include "numa.h"
 #include "random.h"
 #include "search.h"
 #include "transposition.h"
@@ -24,12 +28,56 @@ int main(int argc, char** argv) {
   InitZobristKeys();
   InitPruningAndReductionTables();
   InitAttacks();
-
-  TTInit(32);
+  NumaInit();
 
   // Compliance for OpenBench
-  if (argc > 1 && !strncmp(argv[1], "bench", 5)) {
-    Bench();
+  if (argc > 2 && !strncmp(argv[1], "bench", 5) && !strncmp(argv[2], "scale", 5)) {
+    // bench scale [max threads] [ms per position] [depth, 0 to skip time to depth]
+    BenchScaling(argc > 3 ? atoi(argv[3]) : 0, argc > 4 ? atoi(argv[4]) : 1000,
+                 argc > 5 ? min(MAX_SEARCH_PLY - 1, atoi(argv[5])) : 12);
+  } else if (argc > 1 && !strncmp(argv[1], "bench", 5)) {
+    // bench [threads=N] [hash=MB] [depth=D] [movetime=MS], by default the OpenBench signature run
+    int threads = 1, hash = 0, depth = 13, movetime = 0;
+    for (int i = 2; i < argc; i++) {
+      if (!strncmp(argv[i], "threads=", 8))
+        threads = atoi(argv[i] + 8);
+      else if (!strncmp(argv[i], "hash=", 5))
+        hash = atoi(argv[i] + 5);
+      else if (!strncmp(argv[i], "depth=", 6))
+        depth = min(MAX_SEARCH_PLY - 1, atoi(argv[i] + 6));
+      else if (!strncmp(argv[i], "movetime=", 9))
+        movetime = atoi(argv[i] + 9);
+    }
+
+    if (depth < 1) {
+      printf("info string bench depth must be at least 1\n");
+      return 1;
+    }
+
+    Bench(threads, hash, depth, movetime);
+  } else if (argc > 2 && !strncmp(argv[1], "analyze", 7)) {
+    // analyze file.epd [workers=N] [hash=MB] [depth=D] [movetime=MS] [out=file]
+    int workers = 0, hash = 0, depth = 20, movetime = 0;
+    char* out = NULL;
+    for (int i = 3; i < argc; i++) {
+      if (!strncmp(argv[i], "workers=", 8))
+        workers = atoi(argv[i] + 8);
+      else if (!strncmp(argv[i], "hash=", 5))
+        hash = atoi(argv[i] + 5);
+      else if (!strncmp(argv[i], "depth=", 6))
+        depth = min(MAX_SEARCH_PLY - 1, atoi(argv[i] + 6));
+      else if (!strncmp(argv[i], "movetime=", 9))
+        movetime = atoi(argv[i] + 9);
+      else if (!strncmp(argv[i], "out=", 4))
+        out = argv[i] + 4;
+    }
+
+    if (depth < 1) {
+      printf("info string analyze depth must be at least 1\n");
+      return 1;
+    }
+
+    Analyze(argv[2], out, workers, hash, depth, movetime);
   } else if (argc > 1 && !strncmp(argv[1], "tune", 4)) {
 #ifdef TUNE
     Tune();
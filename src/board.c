@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -11,9 +12,7 @@
 #include "eval.h"
 #include "move.h"
 #include "movegen.h"
-#include "transposition.h"
 #include "types.h"
-#include "uci.h"
 #include "zobrist.h"
 
 const BitBoard EMPTY = 0ULL;
@@ -74,6 +73,12 @@ void ClearBoard(Board* board) {
   board->castling = 0;
   board->moveNo = 0;
   board->halfMove = 0;
+
+  // standard rooks unless the fen says otherwise, a fen without castling rights is not 960
+  board->castleRooks[0] = H1;
+  board->castleRooks[1] = A1;
+  board->castleRooks[2] = H8;
+  board->castleRooks[3] = A8;
 }
 
 void ParseFen(char* fen, Board* board) {
@@ -139,13 +144,8 @@ void ParseFen(char* fen, Board* board) {
     fen++;
   }
 
-  if (board->castleRooks[0] != H1 || board->castleRooks[1] != A1 || board->castleRooks[2] != H8 ||
-      board->castleRooks[3] != A8) {
-    if (!CHESS_960) {
-      CHESS_960 = 1;
-      printf("info string set UCI_Chess960 to value true\n");
-    }
-  }
+  board->chess960 = board->castleRooks[0] != H1 || board->castleRooks[1] != A1 || board->castleRooks[2] != H8 ||
+                    board->castleRooks[3] != A8;
 
   for (int i = 0; i < 64; i++) {
     board->castlingRights[i] = board->castling;
@@ -216,13 +216,13 @@ void BoardToFen(char* fen, Board* board) {
 
   if (board->castling) {
     if (board->castling & 0x8)
-      *fen++ = CHESS_960 ? 'A' + file(board->castleRooks[0]) : 'K';
+      *fen++ = board->chess960 ? 'A' + file(board->castleRooks[0]) : 'K';
     if (board->castling & 0x4)
-      *fen++ = CHESS_960 ? 'A' + file(board->castleRooks[1]) : 'Q';
+      *fen++ = board->chess960 ? 'A' + file(board->castleRooks[1]) : 'Q';
     if (board->castling & 0x2)
-      *fen++ = CHESS_960 ? 'a' + file(board->castleRooks[2]) : 'k';
+      *fen++ = board->chess960 ? 'a' + file(board->castleRooks[2]) : 'k';
     if (board->castling & 0x1)
-      *fen++ = CHESS_960 ? 'a' + file(board->castleRooks[3]) : 'q';
+      *fen++ = board->chess960 ? 'a' + file(board->castleRooks[3]) : 'q';
   } else {
     *fen++ = '-';
   }
@@ -508,9 +508,6 @@ void MakeMove(Move move, Board* board) {
   // special pieces must be loaded after the side has changed
   // this is because the new side to move will be the one in check
   SetSpecialPieces(board);
-
-  // Prefetch the hash entry for this board position
-  TTPrefetch(board->zobrist);
 }
 
 void UndoMove(Move move, Board* board) {
@@ -713,6 +710,19 @@ inline int IsRepetition(Board* board, int ply) {
   return 0;
 }
 
+// Copy what a search reads of a position: the position itself, and the hashes back
+// to the last irreversible move for repetition checks. The other histories are
+// only read back by UndoMove after MakeMove has written them.
+void CopyBoard(Board* to, Board* from) {
+  memcpy(to, from, offsetof(Board, castlingHistory));
+
+  int start = from->moveNo - from->halfMove;
+  if (start < 0)
+    start = 0;
+  if (start < from->moveNo)
+    memcpy(&to->zobristHistory[start], &from->zobristHistory[start], (from->moveNo - start) * sizeof(uint64_t));
+}
+
 void MakeNullMove(Board* board) {
   board->zobristHistory[board->moveNo] = board->zobrist;
   board->castlingHistory[board->moveNo] = board->castling;
@@ -735,9 +745,6 @@ void MakeNullMove(Board* board) {
   board->side = board->xside;
   board->xside ^= 1;
   board->mat = -board->mat;
-
-  // Prefetch the hash entry for this board position
-  TTPrefetch(board->zobrist);
 }
 
 void UndoNullMove(Board* board) {
@@ -35,6 +35,7 @@ void SetOccupancies(Board* board);
 
 int DoesMoveCheck(Move move, Board* board);
 int IsRepetition(Board* board, int ply);
+void CopyBoard(Board* to, Board* from);
 
 int HasNonPawn(Board* board);
 int IsOCB(Board* board);
@@ -0,0 +1,84 @@
+
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "engine.h"
+#include "numa.h"
+#include "thread.h"
+#include "transposition.h"
+#include "types.h"
+
+// placement on NUMA nodes follows NumaSetThreads, the caller sets it first
+Engine* CreateEngine(int hash, int threads) {
+  Engine* engine = calloc(1, sizeof(Engine));
+
+  engine->multiPV = 1;
+  engine->moveOverhead = 100;
+  engine->ponderEnabled = 1;
+  pthread_mutex_init(&engine->ponderMutex, NULL);
+  pthread_cond_init(&engine->ponderEnded, NULL);
+
+  // the pool's workers clear the table
+  engine->threads = CreatePool(engine, threads, 0);
+  TTInit(&engine->tt, hash, engine->threads);
+
+  return engine;
+}
+
+// stops any search first, this also detaches from a SharedHash segment (the last process out removes it)
+void DestroyEngine(Engine* engine) {
+  StopEngine(engine);
+
+  DestroyPool(engine->threads);
+  TTFree(&engine->tt);
+
+  pthread_mutex_destroy(&engine->ponderMutex);
+  pthread_cond_destroy(&engine->ponderEnded);
+  free(engine);
+}
+
+// the table is placed again when the new count changes whether threads are spread over nodes
+void SetThreads(Engine* engine, int count) {
+  int spread = NumaSpread();
+  NumaSetThreads(count);
+
+  DestroyPool(engine->threads);
+  engine->threads = CreatePool(engine, count, 0);
+
+  if (NumaSpread() != spread)
+    TTInit(&engine->tt, engine->tt.size / MEGABYTE, engine->threads);
+}
+
+// end the search started by go, returning once it has printed its bestmove
+void StopEngine(Engine* engine) {
+  SetPondering(engine, 0);
+  __atomic_store_n(&engine->params.stopped, 1, __ATOMIC_RELAXED);
+  WaitJob(engine->threads);
+}
+
+void NewGame(Engine* engine) {
+  // file backed and shared tables are kept across games, aging them is enough
+  if (engine->tt.header)
+    TTUpdate(&engine->tt);
+  else
+    TTClear(&engine->tt, engine->threads);
+
+  ResetThreadPool(engine->threads);
+}
+
+int Pondering(Engine* engine) { return __atomic_load_n(&engine->pondering, __ATOMIC_ACQUIRE); }
+
+void SetPondering(Engine* engine, int pondering) {
+  pthread_mutex_lock(&engine->ponderMutex);
+  __atomic_store_n(&engine->pondering, pondering, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&engine->ponderEnded);
+  pthread_mutex_unlock(&engine->ponderMutex);
+}
+
+void WaitWhilePondering(Engine* engine) {
+  pthread_mutex_lock(&engine->ponderMutex);
+  while (__atomic_load_n(&engine->pondering, __ATOMIC_ACQUIRE))
+    pthread_cond_wait(&engine->ponderEnded, &engine->ponderMutex);
+  pthread_mutex_unlock(&engine->ponderMutex);
+}
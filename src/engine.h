@@ -0,0 +1,44 @@
+
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <pthread.h>
+
+#include "transposition.h"
+#include "types.h"
+
+// Everything one engine instance searches with. Nothing here is shared between
+// instances, so several can run in one process (the uci loop is one client, bench
+// and batch analysis create their own). Only the lookup tables built once at
+// startup (attacks, zobrist keys, psqt, reductions) are process wide, they are
+// never written after that.
+struct Engine {
+  TTTable tt;
+  ThreadData* threads;
+  SearchParams params; // of the search started by go
+  Board board;         // the position go searches
+
+  // uci options
+  int multiPV;
+  int moveOverhead;
+  int ponderEnabled;
+  int chess960;
+
+  // a search that finishes while pondering sleeps on ponderEnded until ponderhit or stop
+  int pondering;
+  pthread_mutex_t ponderMutex;
+  pthread_cond_t ponderEnded;
+};
+
+Engine* CreateEngine(int hash, int threads);
+void DestroyEngine(Engine* engine);
+void SetThreads(Engine* engine, int count);
+void StopEngine(Engine* engine);
+void NewGame(Engine* engine);
+
+int Pondering(Engine* engine);
+void SetPondering(Engine* engine, int pondering);
+void WaitWhilePondering(Engine* engine);
+
+#endif
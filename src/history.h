@@ -5,11 +5,12 @@
 
 #include "types.h"
 
-void AddKillerMove(SearchData* data, Move move);
+void AddKillerMove(SearchStack* ss, Move move);
 void AddCounterMove(SearchData* data, Move move, Move parent);
 void AddHistoryHeuristic(int* entry, int inc);
-void UpdateHistories(SearchData* data, Move bestMove, int depth, int stm, Move quiets[], int nQ);
-int GetHistory(SearchData* data, Move move, int stm);
-int GetCounterHistory(SearchData* data, Move move);
+void UpdateHistories(SearchData* data, SearchStack* ss, Move bestMove, int depth, int stm, Move quiets[], int nQ);
+int GetHistory(SearchData* data, SearchStack* ss, Move move, int stm);
+int GetCounterHistory(SearchStack* ss, Move move);
+void PushMove(SearchData* data, SearchStack* ss, Move move);
 
 #endif
\ No newline at end of file
@@ -37,7 +37,7 @@ char* MoveToStr(Move move, Board* board) {
   int start = MoveStart(move);
   int end = MoveEnd(move);
 
-  if (CHESS_960 && MoveCastle(move)) {
+  if (board->chess960 && MoveCastle(move)) {
     switch (end) {
     case G1:
       end = board->castleRooks[0];
@@ -65,8 +65,8 @@ char* MoveToStr(Move move, Board* board) {
   return buffer;
 }
 
-inline int IsRecapture(SearchData* data, Move move) {
-  Move parent = data->moves[data->ply - 1];
+inline int IsRecapture(SearchStack* ss, Move move) {
+  Move parent = (ss - 1)->move;
 
   return !(MoveCapture(parent) ^ MoveCapture(move)) && MoveEnd(parent) == MoveEnd(move);
 }
\ No newline at end of file
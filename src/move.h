@@ -30,6 +30,6 @@ extern const char* SQ_TO_COORD[];
 
 Move ParseMove(char* moveStr, Board* board);
 char* MoveToStr(Move move, Board* board);
-int IsRecapture(SearchData* data, Move move);
+int IsRecapture(SearchStack* ss, Move move);
 
 #endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <stdio.h>
 
 #include "board.h"
+#include "engine.h"
 #include "eval.h"
 #include "history.h"
 #include "move.h"
@@ -12,7 +13,7 @@
 #include "transposition.h"
 #include "types.h"
 
-void InitAllMoves(MoveList* moves, Move hashMove, SearchData* data) {
+void InitAllMoves(MoveList* moves, Move hashMove, SearchData* data, SearchStack* ss) {
   moves->type = ALL_MOVES;
   moves->phase = HASH_MOVE;
   moves->nTactical = 0;
@@ -21,13 +22,14 @@ void InitAllMoves(MoveList* moves, Move hashMove, SearchData* data) {
   moves->seeCutoff = 0;
 
   moves->hashMove = hashMove;
-  moves->killer1 = data->killers[data->ply][0];
-  moves->killer2 = data->killers[data->ply][1];
+  moves->killer1 = ss->killers[0];
+  moves->killer2 = ss->killers[1];
 
-  Move parent = data->ply > 0 ? data->moves[data->ply - 1] : NULL_MOVE;
+  Move parent = (ss - 1)->move;
   moves->counter = parent ? data->counters[MoveStartEnd(parent)] : NULL_MOVE;
 
   moves->data = data;
+  moves->ss = ss;
 }
 
 void InitTacticalMoves(MoveList* moves, SearchData* data, int cutoff) {
@@ -44,6 +46,7 @@ void InitTacticalMoves(MoveList* moves, SearchData* data, int cutoff) {
   moves->counter = NULL_MOVE;
 
   moves->data = data;
+  moves->ss = NULL;
 }
 
 void InitPerftMoves(MoveList* moves, Board* board) {
@@ -126,11 +129,11 @@ void ScoreTacticalMoves(MoveList* moves, Board* board) {
   }
 }
 
-void ScoreQuietMoves(MoveList* moves, Board* board, SearchData* data) {
+void ScoreQuietMoves(MoveList* moves, Board* board) {
   for (int i = 0; i < moves->nQuiets; i++) {
     Move m = moves->quiet[i];
 
-    moves->sQuiet[i] = GetHistory(data, m, board->side);
+    moves->sQuiet[i] = GetHistory(moves->data, moves->ss, m, board->side);
   }
 }
 
@@ -204,7 +207,7 @@ Move NextMove(MoveList* moves, Board* board, int skipQuiets) {
   case GEN_QUIET_MOVES:
     if (!skipQuiets) {
       GenerateQuietMoves(moves, board);
-      ScoreQuietMoves(moves, board, moves->data);
+      ScoreQuietMoves(moves, board);
     }
 
     moves->phase = PLAY_QUIETS;
@@ -275,20 +278,21 @@ char* PhaseName(MoveList* list) {
 }
 
 void PrintMoves(Board* board, ThreadData* thread) {
-  int hit = 0;
-  TTEntry* tt = TTProbe(&hit, board->zobrist);
+  TTData tt;
+  Move hashMove = TTProbe(&thread->engine->tt, &tt, board->zobrist) ? TTMove(&tt, board) : NULL_MOVE;
 
-  printf("#HM: %5s\n", hit ? MoveToStr(tt->move, board) : "N/A");
+  printf("#HM: %5s\n", hashMove ? MoveToStr(hashMove, board) : "N/A");
 
-  Move k1 = thread->data.killers[0][0];
-  Move k2 = thread->data.killers[0][1];
+  SearchStack* ss = &thread->data.stack[STACK_OFFSET];
+  Move k1 = ss->killers[0];
+  Move k2 = ss->killers[1];
 
   printf("#K1: %5s\n", k1 ? MoveToStr(k1, board) : "N/A");
   printf("#K2: %5s\n\n", k2 ? MoveToStr(k2, board) : "N/A");
 
   thread->data.ply = 0;
   MoveList list = {0};
-  InitAllMoves(&list, hit ? tt->move : NULL_MOVE, &thread->data);
+  InitAllMoves(&list, hashMove, &thread->data, ss);
 
   int i = 1;
   Move move;
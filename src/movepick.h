@@ -5,7 +5,7 @@
 
 #include "types.h"
 
-void InitAllMoves(MoveList* moves, Move hashMove, SearchData* data);
+void InitAllMoves(MoveList* moves, Move hashMove, SearchData* data, SearchStack* ss);
 void InitTacticalMoves(MoveList* moves, SearchData* data, int cutoff);
 void InitPerftMoves(MoveList* moves, Board* board);
 Move NextMove(MoveList* moves, Board* board, int skipQuiets);
@@ -0,0 +1,127 @@
+
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "numa.h"
+
+#define MAX_NODES 64
+#define MPOL_INTERLEAVE 3
+
+int NUMA_ENABLED = 1;
+
+// threads the process searches with, set before their pool and table are made
+int numaThreads = 1;
+
+#if defined(__linux__)
+int nodeCount = 0;
+int nodeIds[MAX_NODES];
+cpu_set_t nodeCpus[MAX_NODES];
+
+// parse a sysfs cpulist such as "0-15,32-47"
+void ParseCpuList(char* list, cpu_set_t* cpus) {
+  CPU_ZERO(cpus);
+
+  for (char* range = strtok(list, ",\n"); range; range = strtok(NULL, ",\n")) {
+    int first, last;
+    int n = sscanf(range, "%d-%d", &first, &last);
+    if (n < 1)
+      continue;
+    if (n == 1)
+      last = first;
+
+    for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+      CPU_SET(cpu, cpus);
+  }
+}
+#endif
+
+// find the nodes that have cpus, node ids can have gaps
+void NumaInit() {
+#if defined(__linux__)
+  nodeCount = 0;
+
+  for (int node = 0; node < MAX_NODES; node++) {
+    char path[64], list[4096];
+    sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+
+    FILE* fp = fopen(path, "r");
+    if (!fp)
+      continue;
+
+    if (fgets(list, sizeof(list), fp)) {
+      ParseCpuList(list, &nodeCpus[nodeCount]);
+      if (CPU_COUNT(&nodeCpus[nodeCount]))
+        nodeIds[nodeCount++] = node;
+    }
+
+    fclose(fp);
+  }
+#endif
+}
+
+// nodes threads and memory can be spread over, 1 when there is nothing to spread
+int NumaNodes() {
+#if defined(__linux__)
+  return NUMA_ENABLED && nodeCount > 1 ? nodeCount : 1;
+#else
+  return 1;
+#endif
+}
+
+void NumaSetThreads(int threads) { numaThreads = threads; }
+
+// Only as many threads as no single node has cpus for are spread, fewer are left to
+// the scheduler (pinned round robin they would all start on node 0) and their memory
+// is left where they touch it.
+int NumaSpread() {
+#if defined(__linux__)
+  if (NumaNodes() < 2)
+    return 0;
+
+  int largest = 0;
+  for (int i = 0; i < nodeCount; i++)
+    largest = CPU_COUNT(&nodeCpus[i]) > largest ? CPU_COUNT(&nodeCpus[i]) : largest;
+
+  return numaThreads > largest;
+#else
+  return 0;
+#endif
+}
+
+// threads are dealt out round robin, each one may run on any cpu of its node
+void NumaBindThread(int idx) {
+#if defined(__linux__)
+  if (NumaSpread())
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &nodeCpus[idx % nodeCount]);
+#else
+  (void)idx;
+#endif
+}
+
+// have the kernel place the pages of a region round robin over all nodes as they
+// are first touched, for memory every thread reads from like the TT
+void NumaInterleave(void* addr, size_t size) {
+#if defined(__linux__)
+  if (!NumaSpread())
+    return;
+
+  unsigned long mask[MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+  for (int i = 0; i < nodeCount; i++)
+    mask[nodeIds[i] / (8 * sizeof(unsigned long))] |= 1UL << (nodeIds[i] % (8 * sizeof(unsigned long)));
+
+  syscall(SYS_mbind, addr, size, MPOL_INTERLEAVE, mask, MAX_NODES + 1, 0);
+#else
+  (void)addr;
+  (void)size;
+#endif
+}
@@ -0,0 +1,17 @@
+
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stddef.h>
+
+extern int NUMA_ENABLED;
+
+void NumaInit();
+int NumaNodes();
+void NumaSetThreads(int threads);
+int NumaSpread();
+void NumaBindThread(int idx);
+void NumaInterleave(void* addr, size_t size);
+
+#endif
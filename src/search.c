@@ -4,12 +4,12 @@
 #include <inttypes.h>
 #include <math.h>
 #include <pthread.h>
-#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "board.h"
+#include "engine.h"
 #include "eval.h"
 #include "history.h"
 #include "move.h"
@@ -21,6 +21,7 @@
 #include "see.h"
 #include "tb.h"
 #include "thread.h"
+#include "timeman.h"
 #include "transposition.h"
 #include "types.h"
 #include "util.h"
@@ -29,7 +30,12 @@
 int LMR[MAX_SEARCH_PLY][64];
 int LMP[2][MAX_SEARCH_PLY];
 int STATIC_PRUNE[2][MAX_SEARCH_PLY];
-extern volatile int PONDERING;
+
+// Lazy SMP helper scheduling, helper i skips depths on a cycle of SKIP_SIZE
+// searched then SKIP_SIZE skipped, offset by SKIP_PHASE, so the helpers spread
+// over several depths rather than all repeating the main thread's
+const int SKIP_SIZE[20] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+const int SKIP_PHASE[20] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
 
 void InitPruningAndReductionTables() {
   for (int depth = 1; depth < MAX_SEARCH_PLY; depth++)
@@ -50,62 +56,223 @@ void InitPruningAndReductionTables() {
   }
 }
 
-INLINE int StopSearch(SearchParams* params) {
-  return params->timeset && GetTimeMS() - params->start > min(params->alloc, params->max) && !PONDERING;
+// Each thread checks the limits every 1024 of its own nodes (~1ms at 1Mnps). Under a
+// node limit the interval shrinks to the thread's share of the nodes left, so the
+// summed count overshoots by at most a node per thread (none with one thread).
+INLINE int StopSearch(ThreadData* thread) {
+  SearchParams* params = thread->params;
+  SearchData* data = &thread->data;
+
+  uint64_t interval = 1024;
+  if (params->nodes) {
+    uint64_t nodes = NodesSearched(thread->threads);
+    if (nodes >= params->nodes)
+      return 1;
+
+    interval = min(interval, max(1, (params->nodes - nodes) / thread->count));
+  }
+  data->nextCheck = data->nodes + interval;
+
+  return params->timeset && GetTimeMS() - params->start > params->hardLimit && !Pondering(thread->engine);
 }
 
-void* UCISearch(void* arg) {
-  SearchArgs* args = (SearchArgs*)arg;
+// Set by the main thread, the uci thread or whichever thread first runs out of
+// time, and polled at every node. A stopped search unwinds through its returns
+// (undoing every move) and nothing it returns after the flag is set is used.
+INLINE int Stopped(SearchParams* params) { return __atomic_load_n(&params->stopped, __ATOMIC_RELAXED); }
+
+INLINE void SetStopped(SearchParams* params, int stopped) {
+  __atomic_store_n(&params->stopped, stopped, __ATOMIC_RELAXED);
+}
 
-  Board* board = args->board;
-  SearchParams* params = args->params;
-  ThreadData* threads = args->threads;
+// the search started by go, run on the main thread's worker
+void* UCISearch(void* arg) {
+  Engine* engine = (Engine*)arg;
 
   SearchResults results = {0};
-  BestMove(board, params, threads, &results);
+  BestMove(&engine->board, &engine->params, engine->threads, &results);
 
-  free(args);
   return NULL;
 }
 
 void BestMove(Board* board, SearchParams* params, ThreadData* threads, SearchResults* results) {
+  Engine* engine = threads->engine;
+
   Move bestMove;
   if ((bestMove = TBRootProbe(board))) {
-    while (PONDERING)
-      ;
+    WaitWhilePondering(engine);
 
     printf("bestmove %s\n", MoveToStr(bestMove, board));
   } else if ((bestMove = ProbeNoob(board))) {
-    while (PONDERING)
-      ;
+    WaitWhilePondering(engine);
 
     printf("bestmove %s\n", MoveToStr(bestMove, board));
   } else {
-    pthread_t pthreads[threads->count];
+    // stopped is cleared by whoever set up params, a stop sent before this point still counts
     InitPool(board, params, threads, results);
+    TTUpdate(&engine->tt);
 
-    params->stopped = 0;
-    TTUpdate();
-
-    // start at 1, we will resuse main-thread
-    for (int i = 1; i < threads->count; i++)
-      pthread_create(&pthreads[i], NULL, &Search, &threads[i]);
+    // wake the helpers, the calling thread searches as the main thread
+    StartHelpers(threads, &Search);
     Search(&threads[0]);
 
     // if main thread stopped, then stop all and wait till complete
-    params->stopped = 1;
-    for (int i = 1; i < threads->count; i++)
-      pthread_join(pthreads[i], NULL);
+    SetStopped(params, 1);
+    WaitHelpers(threads);
+
+    Move ponderMove = results->ponderMoves[results->depth];
+    bestMove = results->bestMoves[results->depth];
+    results->score = threads->completedScore;
+
+    // stopped before completing a depth (a tiny node budget, an immediate stop), the root's first choice is played
+    if (!bestMove && threads->numRootMoves)
+      bestMove = threads->rootMoves[0].move;
+
+    // a helper may have got deeper or found better, multipv output is the main thread's
+    ThreadData* best = params->multiPV == 1 ? BestThread(threads) : threads;
+    if (best != threads) {
+      best->depth = best->completedDepth;
+      PrintInfo(&best->completedPv, best->completedScore, best, -CHECKMATE, CHECKMATE, 1, board);
+
+      bestMove = best->completedPv.moves[0];
+      ponderMove = best->completedPv.count > 1 ? best->completedPv.moves[1] : NULL_MOVE;
+      results->score = best->completedScore;
+    }
 
-    while (PONDERING)
-      ;
+    WaitWhilePondering(engine);
 
-    printf("bestmove %s", MoveToStr(results->bestMoves[results->depth], board));
-    if (results->ponderMoves[results->depth])
-      printf(" ponder %s", MoveToStr(results->ponderMoves[results->depth], board));
+    printf("bestmove %s", MoveToStr(bestMove, board));
+    if (ponderMove)
+      printf(" ponder %s", MoveToStr(ponderMove, board));
 
     printf("\n");
+
+#ifdef TT_STATS
+    TTStats total = {0};
+    for (int i = 0; i < threads->count; i++) {
+      TTAddStats(&total, &threads[i].ttStats);
+
+      if (threads->count > 1) {
+        char who[32];
+        snprintf(who, sizeof(who), "thread %d", i);
+        TTPrintStats(&threads[i].ttStats, who);
+      }
+    }
+    TTPrintStats(&total, "total");
+#endif
   }
+
+  results->bestMove = bestMove;
+}
+
+// votes for a root move, from every thread that completed a depth with it as best
+INLINE int64_t Votes(ThreadData* threads, Move move, int minScore) {
+  int64_t votes = 0;
+  for (int i = 0; i < threads->count; i++)
+    if (threads[i].completedDepth && threads[i].completedPv.moves[0] == move)
+      votes += (int64_t)(threads[i].completedScore - minScore + 14) * threads[i].completedDepth;
+
+  return votes;
+}
+
+// Pick the thread whose result is played. Each thread votes for its best move,
+// weighted by its depth and by how far its score is above the lowest score any
+// thread reports, and the most voted move wins (the main thread's on a tie).
+// A proven win is taken over the vote, the shortest of them if there are several.
+ThreadData* BestThread(ThreadData* threads) {
+  ThreadData* best = threads;
+
+  int minScore = CHECKMATE;
+  for (int i = 0; i < threads->count; i++)
+    if (threads[i].completedDepth)
+      minScore = min(minScore, threads[i].completedScore);
+
+  for (int i = 1; i < threads->count; i++) {
+    ThreadData* thread = &threads[i];
+    if (!thread->completedDepth || !thread->completedPv.count)
+      continue;
+
+    int score = thread->completedScore;
+    if (!best->completedDepth || !best->completedPv.count) {
+      best = thread;
+    } else if (abs(best->completedScore) >= TB_WIN_BOUND) {
+      if (score > best->completedScore)
+        best = thread;
+    } else if (score >= TB_WIN_BOUND ||
+               (score > -TB_WIN_BOUND && Votes(threads, thread->completedPv.moves[0], minScore) >
+                                             Votes(threads, best->completedPv.moves[0], minScore))) {
+      best = thread;
+    }
+  }
+
+  return best;
+}
+
+// the pv of the node at ply is the move raising alpha there followed by its child's pv,
+// which the child left in the next row of the table
+INLINE void UpdatePV(SearchData* data, Move move) {
+  PV* pv = &data->pvTable[data->ply];
+  PV* child = &data->pvTable[data->ply + 1];
+
+  pv->count = child->count + 1;
+  pv->moves[0] = move;
+  memcpy(pv->moves + 1, child->moves, child->count * sizeof(Move));
+}
+
+// the root searches only these, in the order of the move picker to begin with
+INLINE void InitRootMoves(ThreadData* thread) {
+  SearchParams* params = thread->params;
+  SearchData* data = &thread->data;
+  Board* board = &thread->board;
+
+  TTData tt = {0};
+  Move hashMove = TTProbe(&thread->engine->tt, &tt, board->zobrist) ? TTMove(&tt, board) : NULL_MOVE;
+
+  MoveList moves;
+  InitAllMoves(&moves, hashMove, data, &data->stack[STACK_OFFSET]);
+
+  Move move;
+  thread->numRootMoves = 0;
+  while ((move = NextMove(&moves, board, 0))) {
+    if (params->searchMoves) {
+      int i = 0;
+      while (i < params->searchable.count && params->searchable.moves[i] != move)
+        i++;
+
+      if (i == params->searchable.count)
+        continue;
+    }
+
+    thread->rootMoves[thread->numRootMoves++] = (RootMove){.move = move, .score = -UNKNOWN, .previousScore = -UNKNOWN};
+  }
+}
+
+INLINE int RootMoveBefore(RootMove* a, RootMove* b) {
+  return a->score != b->score ? a->score > b->score : a->previousScore > b->previousScore;
+}
+
+// insertion sort, stable so moves without a score keep the order of the previous iteration
+INLINE void SortRootMoves(RootMove* moves, int count) {
+  for (int i = 1; i < count; i++) {
+    RootMove rm = moves[i];
+
+    int j = i;
+    for (; j > 0 && RootMoveBefore(&rm, &moves[j - 1]); j--)
+      moves[j] = moves[j - 1];
+
+    moves[j] = rm;
+  }
+}
+
+// the next root move from idx on, the lines multipv has taken already sit before it
+INLINE Move NextRootMove(ThreadData* thread, int* idx, int skipQuiets) {
+  while (*idx < thread->numRootMoves) {
+    Move move = thread->rootMoves[(*idx)++].move;
+    if (!skipQuiets || Tactical(move))
+      return move;
+  }
+
+  return NULL_MOVE;
 }
 
 void* Search(void* arg) {
@@ -120,121 +287,172 @@ void* Search(void* arg) {
   int beta = CHECKMATE;
   int score = 0;
 
-  // set a hot exit point for this thread
-  if (!setjmp(thread->exit)) {
-
-    // Iterative deepening
-    for (int depth = 1; depth <= params->depth; depth++) {
-      for (thread->multiPV = 0; thread->multiPV < params->multiPV; thread->multiPV++) {
-        PV* pv = &thread->pvs[thread->multiPV];
-
-        // delta is our window for search. early depths get full searches
-        // as we don't know what score to expect. Otherwise we start with a window of 16 (8x2), but
-        // vary this slightly based on the previous depths window expansion count
-        int delta;
-        int searchDepth = depth;
-        thread->depth = searchDepth;
-
-        if (depth >= 5 && abs(score) <= 1000) {
-          alpha = max(score - WINDOW, -CHECKMATE);
-          beta = min(score + WINDOW, CHECKMATE);
-          delta = WINDOW;
-
-          int contempt =
-              (abs(score) <= 100) * score / 4 + (score > 100) * (20 + score / 20) + (score < -100) * (-20 + score / 20);
-          contempt = max(-40, min(40, contempt));
-          data->contempt =
-              board->side == WHITE ? makeScore(contempt, contempt / 2) : -makeScore(contempt, contempt / 2);
-        } else {
-          alpha = -CHECKMATE;
-          beta = CHECKMATE;
-          delta = CHECKMATE;
-        }
+  TimeManager tm;
+  TMInit(&tm, params);
 
-        while (!params->stopped) {
-          // search!
-          score = Negamax(alpha, beta, searchDepth, thread, pv);
-
-          if (mainThread && (score <= alpha || score >= beta) && thread->multiPV == 0 &&
-              GetTimeMS() - params->start >= 2500)
-            PrintInfo(pv, score, thread, alpha, beta, 1, board);
-
-          if (score <= alpha) {
-            // adjust beta downward when failing low
-            beta = (alpha + beta) / 2;
-            alpha = max(alpha - delta, -CHECKMATE);
-
-            searchDepth = depth;
-          } else if (score >= beta) {
-            beta = min(beta + delta, CHECKMATE);
-
-            if (abs(score) < TB_WIN_BOUND)
-              searchDepth--;
-          } else {
-            thread->scores[thread->multiPV] = score;
-            thread->bestMoves[thread->multiPV] = pv->moves[0];
-            break;
-          }
-
-          // delta x 1.5
-          delta += delta / 2;
-        }
+#ifdef TT_STATS
+  ttStats = &thread->ttStats;
+#endif
+
+  InitRootMoves(thread);
+
+  // Iterative deepening
+  for (int depth = 1; depth <= params->depth; depth++) {
+    if (!mainThread) {
+      int i = (thread->idx - 1) % 20;
+      if ((depth + SKIP_PHASE[i]) / SKIP_SIZE[i] % 2)
+        continue;
+
+      // more than half the threads on this depth already, move on to the next
+      if (__atomic_load_n(&results->searching[depth], __ATOMIC_RELAXED) * 2 > thread->count)
+        continue;
+    }
+
+    __atomic_add_fetch(&results->searching[depth], 1, __ATOMIC_RELAXED);
+    TMStartDepth(&tm);
+
+    for (int i = 0; i < thread->numRootMoves; i++)
+      thread->rootMoves[i].previousScore = thread->rootMoves[i].score;
+
+    for (thread->multiPV = 0; thread->multiPV < params->multiPV; thread->multiPV++) {
+      PV* pv = &thread->pvs[thread->multiPV];
+
+      // delta is our window for search. early depths get full searches
+      // as we don't know what score to expect. Otherwise we start with a window of 16 (8x2), but
+      // vary this slightly based on the previous depths window expansion count
+      int delta;
+      int searchDepth = depth;
+      thread->depth = searchDepth;
+
+      if (depth >= 5 && abs(score) <= 1000) {
+        // helpers open with a quarter, a half or three quarters wider windows, so they fail and re-search differently
+        int widen = thread->idx ? (thread->idx - 1) % 3 + 1 : 0;
+        delta = WINDOW + widen * WINDOW / 4;
+        alpha = max(score - delta, -CHECKMATE);
+        beta = min(score + delta, CHECKMATE);
+
+        int contempt =
+            (abs(score) <= 100) * score / 4 + (score > 100) * (20 + score / 20) + (score < -100) * (-20 + score / 20);
+        contempt = max(-40, min(40, contempt));
+        data->contempt =
+            board->side == WHITE ? makeScore(contempt, contempt / 2) : -makeScore(contempt, contempt / 2);
+      } else {
+        alpha = -CHECKMATE;
+        beta = CHECKMATE;
+        delta = CHECKMATE;
       }
 
-      // sort multi pv
-      for (int i = 0; i < params->multiPV; i++) {
-        int best = i;
+      while (!Stopped(params)) {
+        // search!
+        score = Negamax(alpha, beta, searchDepth, thread);
+        if (Stopped(params))
+          break;
+
+        // the best move of this line moves up to its index, ready for the next search or line
+        SortRootMoves(thread->rootMoves + thread->multiPV, thread->numRootMoves - thread->multiPV);
+
+        // the root's row is reused by the next line, so each line keeps its own copy
+        pv->count = data->pvTable[0].count;
+        memcpy(pv->moves, data->pvTable[0].moves, pv->count * sizeof(Move));
 
-        for (int j = i + 1; j < params->multiPV; j++)
-          if (thread->scores[j] > thread->scores[best])
-            best = j;
+        if (mainThread && !params->quiet && (score <= alpha || score >= beta) && thread->multiPV == 0 &&
+            GetTimeMS() - params->start >= 2500)
+          PrintInfo(pv, score, thread, alpha, beta, 1, board);
 
-        if (best != i) {
-          Score tempS = thread->scores[best];
-          Move tempM = thread->bestMoves[best];
+        if (mainThread && thread->multiPV == 0) {
+          tm.failLows += score <= alpha;
+          tm.failHighs += score >= beta;
+        }
+
+        if (score <= alpha) {
+          // adjust beta downward when failing low
+          beta = (alpha + beta) / 2;
+          alpha = max(alpha - delta, -CHECKMATE);
 
-          thread->scores[best] = thread->scores[i];
-          thread->bestMoves[best] = thread->bestMoves[i];
+          searchDepth = depth;
+        } else if (score >= beta) {
+          beta = min(beta + delta, CHECKMATE);
 
-          thread->scores[i] = tempS;
-          thread->bestMoves[i] = tempM;
+          if (abs(score) < TB_WIN_BOUND)
+            searchDepth--;
+        } else {
+          thread->scores[thread->multiPV] = score;
+          thread->bestMoves[thread->multiPV] = pv->moves[0];
+          break;
         }
+
+        // delta x 1.5
+        delta += delta / 2;
       }
+    }
 
-      if (mainThread)
-        for (int i = 0; i < params->multiPV; i++)
-          PrintInfo(&thread->pvs[i], thread->scores[i], thread, -CHECKMATE, CHECKMATE, i + 1, board);
+    __atomic_sub_fetch(&results->searching[depth], 1, __ATOMIC_RELAXED);
 
-      results->depth = depth;
-      results->scores[depth] = thread->scores[0];
-      results->bestMoves[depth] = thread->bestMoves[0];
-      results->ponderMoves[depth] = thread->pvs[0].count > 1 ? thread->pvs[0].moves[1] : NULL_MOVE;
+    // a depth cut short by the stop (or never started by a late helper) has nothing to report
+    if (Stopped(params))
+      break;
 
-      if (!mainThread || depth < 5 || !params->timeset)
-        continue;
+    // sort multi pv
+    for (int i = 0; i < params->multiPV; i++) {
+      int best = i;
 
-      int diff = results->scores[depth] - results->scores[depth - 1];
+      for (int j = i + 1; j < params->multiPV; j++)
+        if (thread->scores[j] > thread->scores[best])
+          best = j;
 
-      if (abs(diff) <= WINDOW)
-        continue;
+      if (best != i) {
+        Score tempS = thread->scores[best];
+        Move tempM = thread->bestMoves[best];
+        PV tempP = thread->pvs[best];
+
+        thread->scores[best] = thread->scores[i];
+        thread->bestMoves[best] = thread->bestMoves[i];
+        thread->pvs[best] = thread->pvs[i];
 
-      if (diff < 0)
-        params->alloc *= fmin(1.16, 1.04 * (-diff / WINDOW));
-      else
-        params->alloc *= fmin(1.04, 1.02 * (diff / WINDOW));
+        thread->scores[i] = tempS;
+        thread->bestMoves[i] = tempM;
+        thread->pvs[i] = tempP;
+      }
     }
+
+    SortRootMoves(thread->rootMoves, params->multiPV);
+
+    if (mainThread && !params->quiet)
+      for (int i = 0; i < params->multiPV; i++)
+        PrintInfo(&thread->pvs[i], thread->scores[i], thread, -CHECKMATE, CHECKMATE, i + 1, board);
+
+    thread->completedDepth = depth;
+    thread->completedScore = thread->scores[0];
+    thread->completedPv = thread->pvs[0];
+
+    if (!mainThread)
+      continue;
+
+    results->depth = depth;
+    results->scores[depth] = thread->scores[0];
+    results->bestMoves[depth] = thread->bestMoves[0];
+    results->ponderMoves[depth] = thread->pvs[0].count > 1 ? thread->pvs[0].moves[1] : NULL_MOVE;
+
+    // go mate is done once a mate in that many moves or fewer is found
+    int mateFound = params->mate && thread->scores[0] >= CHECKMATE - (2 * params->mate - 1);
+
+    // a ponder search goes on until ponderhit or stop, the hard limit still applies after ponderhit
+    if ((TMStopAfterDepth(&tm, thread, depth) || mateFound) && !Pondering(thread->engine))
+      break;
   }
 
   return NULL;
 }
 
-int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
+int Negamax(int alpha, int beta, int depth, ThreadData* thread) {
   SearchParams* params = thread->params;
   SearchData* data = &thread->data;
   Board* board = &thread->board;
+  TTTable* table = &thread->engine->tt;
 
-  PV childPv;
-  pv->count = 0;
+  SearchStack* ss = &data->stack[data->ply + STACK_OFFSET];
+  ss->inCheck = board->checkers != 0;
+  data->pvTable[data->ply].count = 0;
 
   int isPV = beta - alpha != 1; // pv node when doing a full window
   int isRoot = !data->ply;      //
@@ -245,7 +463,7 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
   int ttScore = UNKNOWN;
 
   Move bestMove = NULL_MOVE;
-  Move skipMove = data->skipMove[data->ply]; // skip used in SE (concept from SF)
+  Move skipMove = ss->skipMove; // skip used in SE (concept from SF)
   Move nullThreat = NULL_MOVE;
   Move hashMove = NULL_MOVE;
 
@@ -254,16 +472,17 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
 
   // drop into tactical moves only
   if (depth <= 0)
-    return Quiesce(alpha, beta, thread, pv);
+    return Quiesce(alpha, beta, thread);
 
   data->nodes++;
   data->seldepth = max(data->ply, data->seldepth);
 
-  // Either mainthread has ended us OR we've run out of time
-  // this second check is more expensive and done only every 1024 nodes
-  // 1Mnps ~1ms
-  if (params->stopped || (!(data->nodes & 1023) && StopSearch(params)))
-    longjmp(thread->exit, 1);
+  // Either mainthread has ended us OR we've run out of time (or nodes)
+  // this second check is more expensive and done only every so often
+  if (data->nodes >= data->nextCheck && StopSearch(thread))
+    SetStopped(params, 1);
+  if (Stopped(params))
+    return 0;
 
   if (!isRoot) {
     // draw
@@ -283,19 +502,21 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
 
   // check the transposition table for previous info
   // we ignore the tt on singular extension searches
-  int ttHit = 0;
-  TTEntry* tt = skipMove ? NULL : TTProbe(&ttHit, board->zobrist);
+  TTData tt = {0};
+  int ttHit = skipMove ? 0 : TTProbe(table, &tt, board->zobrist);
   if (ttHit) {
-    hashMove = tt->move;
-    ttScore = TTScore(tt, data->ply);
+    hashMove = TTMove(&tt, board);
+    ttScore = TTScore(&tt, data->ply);
   }
 
   // if the TT has a value that fits our position and has been searched to an equal or greater depth, then we accept
   // this score and prune
-  if (!isPV && ttHit && tt->depth >= depth && ttScore != UNKNOWN) {
-    if ((tt->flags & TT_EXACT) || ((tt->flags & TT_LOWER) && ttScore >= beta) ||
-        ((tt->flags & TT_UPPER) && ttScore <= alpha))
+  if (!isPV && ttHit && tt.depth >= depth && ttScore != UNKNOWN) {
+    if ((tt.flags & TT_EXACT) || ((tt.flags & TT_LOWER) && ttScore >= beta) ||
+        ((tt.flags & TT_UPPER) && ttScore <= alpha)) {
+      TT_STAT(cutoffs);
       return ttScore;
+    }
   }
 
   // tablebase - we do not do this at root
@@ -323,7 +544,7 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
 
       // if the tablebase gives us what we want, then we accept it's score and return
       if ((flag & TT_EXACT) || ((flag & TT_LOWER) && score >= beta) || ((flag & TT_UPPER) && score <= alpha)) {
-        TTPut(board->zobrist, depth, score, flag, 0, data->ply, 0);
+        TTPut(table, board->zobrist, depth, score, flag, 0, data->ply, 0);
         return score;
       }
 
@@ -346,28 +567,27 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
   // pull previous static eval from tt - this is depth independent
   int eval;
   if (!skipMove) {
-    eval = data->evals[data->ply] = board->checkers ? UNKNOWN : (ttHit ? tt->eval : Evaluate(board, thread));
+    eval = ss->eval = ss->inCheck ? UNKNOWN : (ttHit ? tt.eval : Evaluate(board, thread));
   } else {
     // after se, just used already determined eval
-    eval = data->evals[data->ply];
+    eval = ss->eval;
   }
 
   if (!ttHit)
-    TTPut(board->zobrist, INT8_MIN, UNKNOWN, TT_UNKNOWN, NULL_MOVE, data->ply, eval);
+    TTPut(table, board->zobrist, INT8_MIN, UNKNOWN, TT_UNKNOWN, NULL_MOVE, data->ply, eval);
 
   // getting better if eval has gone up
-  int improving = !board->checkers && data->ply >= 2 &&
-                  (data->evals[data->ply] > data->evals[data->ply - 2] || data->evals[data->ply - 2] == UNKNOWN);
+  int improving = !ss->inCheck && data->ply >= 2 && (ss->eval > (ss - 2)->eval || (ss - 2)->eval == UNKNOWN);
 
   // reset moves to moves related to 1 additional ply
-  data->skipMove[data->ply + 1] = NULL_MOVE;
-  data->killers[data->ply + 1][0] = NULL_MOVE;
-  data->killers[data->ply + 1][1] = NULL_MOVE;
+  (ss + 1)->skipMove = NULL_MOVE;
+  (ss + 1)->killers[0] = NULL_MOVE;
+  (ss + 1)->killers[1] = NULL_MOVE;
 
-  if (!isPV && !board->checkers) {
+  if (!isPV && !ss->inCheck) {
     // Our TT might have a more accurate evaluation score, use this
-    if (ttHit && tt->depth >= depth && ttScore != UNKNOWN) {
-      if (tt->flags & (ttScore > eval ? TT_LOWER : TT_UPPER))
+    if (ttHit && tt.depth >= depth && ttScore != UNKNOWN) {
+      if (tt.flags & (ttScore > eval ? TT_LOWER : TT_UPPER))
         eval = ttScore;
     }
 
@@ -379,47 +599,58 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
     // Null move pruning
     // i.e. Our position is so good we can give our opponnent a free move and
     // they still can't catch up (this is usually countered by captures or mate threats)
-    if (depth >= 3 && data->moves[data->ply - 1] != NULL_MOVE && !skipMove && eval >= beta && HasNonPawn(board)) {
+    if (depth >= 3 && (ss - 1)->move != NULL_MOVE && !skipMove && eval >= beta && HasNonPawn(board)) {
       int R = 4 + depth / 6 + min((eval - beta) / 256, 3);
       R = min(depth, R); // don't go too low
 
-      data->moves[data->ply++] = NULL_MOVE;
+      PushMove(data, ss, NULL_MOVE);
+      data->ply++;
       MakeNullMove(board);
+      TTPrefetch(table, board->zobrist);
 
-      score = -Negamax(-beta, -beta + 1, depth - R, thread, &childPv);
+      score = -Negamax(-beta, -beta + 1, depth - R, thread);
 
       UndoNullMove(board);
       data->ply--;
 
+      if (Stopped(params))
+        return 0;
+
       if (score >= beta)
         return beta;
 
-      nullThreat = childPv.count ? childPv.moves[0] : NULL_MOVE;
+      PV* threat = &data->pvTable[data->ply + 1];
+      nullThreat = threat->count ? threat->moves[0] : NULL_MOVE;
     }
 
     // Prob cut
     // If a relatively deep search from our TT doesn't say this node is
     // less than beta + margin, then we run a shallow search to look
     int probBeta = beta + 110;
-    if (depth > 4 && abs(beta) < MATE_BOUND && !(ttHit && tt->depth >= depth - 3 && ttScore < probBeta)) {
+    if (depth > 4 && abs(beta) < MATE_BOUND && !(ttHit && tt.depth >= depth - 3 && ttScore < probBeta)) {
       InitTacticalMoves(&moves, data, 0);
       while ((move = NextMove(&moves, board, 1))) {
         if (skipMove == move)
           continue;
 
-        data->moves[data->ply++] = move;
+        PushMove(data, ss, move);
+        data->ply++;
         MakeMove(move, board);
+        TTPrefetch(table, board->zobrist);
 
         // qsearch to quickly check
-        score = -Quiesce(-probBeta, -probBeta + 1, thread, pv);
+        score = -Quiesce(-probBeta, -probBeta + 1, thread);
 
         // if it's still above our cutoff, revalidate
         if (score >= probBeta)
-          score = -Negamax(-probBeta, -probBeta + 1, depth - 4, thread, pv);
+          score = -Negamax(-probBeta, -probBeta + 1, depth - 4, thread);
 
         UndoMove(move, board);
         data->ply--;
 
+        if (Stopped(params))
+          return 0;
+
         if (score >= probBeta)
           return score;
       }
@@ -428,14 +659,15 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
 
   Move quiets[64];
   int totalMoves = 0, nonPrunedMoves = 0, numQuiets = 0, skipQuiets = 0;
-  InitAllMoves(&moves, hashMove, data);
+  InitAllMoves(&moves, hashMove, data, ss);
 
-  while ((move = NextMove(&moves, board, skipQuiets))) {
-    if (isRoot && MoveSearchedByMultiPV(thread, move))
-      continue;
-    if (isRoot && !MoveSearchable(params, move))
-      continue;
+  // the root plays its own list (the picker still provides killers and counter)
+  int rootIdx = thread->multiPV;
+  if (isRoot)
+    for (int i = rootIdx; i < thread->numRootMoves; i++)
+      thread->rootMoves[i].score = -UNKNOWN;
 
+  while ((move = isRoot ? NextRootMove(thread, &rootIdx, skipQuiets) : NextMove(&moves, board, skipQuiets))) {
     // don't search this during singular
     if (skipMove == move)
       continue;
@@ -444,8 +676,8 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
 
     int tactical = !!Tactical(move);
     int specialQuiet = !tactical && (move == moves.killer1 || move == moves.killer2 || move == moves.counter);
-    int hist = !tactical ? GetHistory(data, move, board->side) : 0;
-    int counterHist = !tactical ? GetCounterHistory(data, move) : 0;
+    int hist = !tactical ? GetHistory(data, ss, move, board->side) : 0;
+    int counterHist = !tactical ? GetCounterHistory(ss, move) : 0;
 
     if (bestScore > -MATE_BOUND) {
       if (totalMoves >= LMP[improving][depth])
@@ -454,7 +686,7 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
       if (!tactical && !specialQuiet && depth < 3 && counterHist <= -8192)
         continue;
 
-      if (tactical && moves.phase > PLAY_GOOD_TACTICAL && SEE(board, move) < STATIC_PRUNE[1][depth])
+      if (tactical && (isRoot || moves.phase > PLAY_GOOD_TACTICAL) && SEE(board, move) < STATIC_PRUNE[1][depth])
         continue;
 
       if (!tactical && SEE(board, move) < STATIC_PRUNE[0][depth])
@@ -463,7 +695,7 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
 
     nonPrunedMoves++;
 
-    if (isRoot && !thread->idx && GetTimeMS() - params->start > 2500)
+    if (isRoot && !thread->idx && !params->quiet && GetTimeMS() - params->start > 2500)
       printf("info depth %d currmove %s currmovenumber %d\n", thread->depth, MoveToStr(move, board),
              nonPrunedMoves + thread->multiPV);
 
@@ -476,14 +708,17 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
     // moves at a shallow depth on a nullwindow that is somewhere below the tt evaluation
     // implemented using "skip move" recursion like in SF (allows for reductions when doing singular search)
     int extension = 0;
-    if (depth >= 8 && !skipMove && !isRoot && ttHit && move == tt->move && tt->depth >= depth - 3 &&
-        abs(ttScore) < MATE_BOUND && (tt->flags & TT_LOWER)) {
+    if (depth >= 8 && !skipMove && !isRoot && ttHit && move == hashMove && tt.depth >= depth - 3 &&
+        abs(ttScore) < MATE_BOUND && (tt.flags & TT_LOWER)) {
       int sBeta = max(ttScore - 3 * depth / 2, -CHECKMATE);
       int sDepth = depth / 2 - 1;
 
-      data->skipMove[data->ply] = move;
-      score = Negamax(sBeta - 1, sBeta, sDepth, thread, pv);
-      data->skipMove[data->ply] = NULL_MOVE;
+      ss->skipMove = move;
+      score = Negamax(sBeta - 1, sBeta, sDepth, thread);
+      ss->skipMove = NULL_MOVE;
+
+      if (Stopped(params))
+        return 0;
 
       // no score failed above sBeta, so this is singular
       if (score < sBeta)
@@ -494,7 +729,7 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
 
     // history extension - if the tt move has a really good history score, extend.
     // thank you to Connor, author of Seer for this idea
-    else if (!isRoot && depth >= 8 && ttHit && move == tt->move && hist >= 98304)
+    else if (!isRoot && depth >= 8 && ttHit && move == hashMove && hist >= 98304)
       extension = 1;
 
     // castle extensions
@@ -503,11 +738,15 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
 
     // re-capture extension - looks for a follow up capture on the same square
     // as the previous capture
-    else if (isPV && !isRoot && IsRecapture(data, move))
+    else if (isPV && !isRoot && IsRecapture(ss, move))
       extension = 1;
 
-    data->moves[data->ply++] = move;
+    uint64_t nodes = data->nodes;
+
+    PushMove(data, ss, move);
+    data->ply++;
     MakeMove(move, board);
+    TTPrefetch(table, board->zobrist);
 
     // apply extensions
     int newDepth = depth + max(extension, (board->checkers && depth < 8));
@@ -547,21 +786,30 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
 
     // First move of a PV node
     if (isPV && nonPrunedMoves == 1) {
-      score = -Negamax(-beta, -alpha, newDepth - 1, thread, &childPv);
+      score = -Negamax(-beta, -alpha, newDepth - 1, thread);
     } else {
       // potentially reduced search
-      score = -Negamax(-alpha - 1, -alpha, newDepth - R, thread, &childPv);
+      score = -Negamax(-alpha - 1, -alpha, newDepth - R, thread);
 
       if (score > alpha && R != 1) // failed high on a reducede search, try again
-        score = -Negamax(-alpha - 1, -alpha, newDepth - 1, thread, &childPv);
+        score = -Negamax(-alpha - 1, -alpha, newDepth - 1, thread);
 
       if (score > alpha && (isRoot || score < beta)) // failed high again, do full window
-        score = -Negamax(-beta, -alpha, newDepth - 1, thread, &childPv);
+        score = -Negamax(-beta, -alpha, newDepth - 1, thread);
     }
 
     UndoMove(move, board);
     data->ply--;
 
+    if (Stopped(params))
+      return 0;
+
+    if (isRoot) {
+      RootMove* rm = &thread->rootMoves[rootIdx - 1];
+      rm->nodes += data->nodes - nodes;
+      rm->score = nonPrunedMoves == 1 || score > alpha ? score : -UNKNOWN;
+    }
+
     if (score > bestScore) {
       bestScore = score;
       bestMove = move;
@@ -569,15 +817,12 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
       if (score > alpha) {
         alpha = score;
 
-        // copy pv when alpha is raised
-        pv->count = childPv.count + 1;
-        pv->moves[0] = move;
-        memcpy(pv->moves + 1, childPv.moves, childPv.count * sizeof(Move));
+        UpdatePV(data, move);
       }
 
       // we're failing high
       if (alpha >= beta) {
-        UpdateHistories(data, move, depth, board->side, quiets, numQuiets);
+        UpdateHistories(data, ss, move, depth, board->side, quiets, numQuiets);
         break;
       }
     }
@@ -585,7 +830,7 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
 
   // Checkmate detection using movecount
   if (!totalMoves)
-    return board->checkers ? -CHECKMATE + data->ply : 0;
+    return ss->inCheck ? -CHECKMATE + data->ply : 0;
 
   // don't let our score inflate too high (tb)
   bestScore = min(bestScore, maxScore);
@@ -595,28 +840,31 @@ int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv) {
     // save to the TT
     // TT_LOWER = we failed high, TT_UPPER = we didnt raise alpha, TT_EXACT = in
     int TTFlag = bestScore >= beta ? TT_LOWER : bestScore <= origAlpha ? TT_UPPER : TT_EXACT;
-    TTPut(board->zobrist, depth, bestScore, TTFlag, bestMove, data->ply, data->evals[data->ply]);
+    TTPut(table, board->zobrist, depth, bestScore, TTFlag, bestMove, data->ply, ss->eval);
   }
 
   return bestScore;
 }
 
-int Quiesce(int alpha, int beta, ThreadData* thread, PV* pv) {
+int Quiesce(int alpha, int beta, ThreadData* thread) {
   SearchParams* params = thread->params;
   SearchData* data = &thread->data;
   Board* board = &thread->board;
+  TTTable* table = &thread->engine->tt;
 
-  PV childPv;
-  pv->count = 0;
+  SearchStack* ss = &data->stack[data->ply + STACK_OFFSET];
+  ss->inCheck = board->checkers != 0;
+  data->pvTable[data->ply].count = 0;
 
   data->nodes++;
   data->seldepth = max(data->ply, data->seldepth);
 
-  // Either mainthread has ended us OR we've run out of time
-  // this second check is more expensive and done only every 1024 nodes
-  // 1Mnps ~1ms
-  if (params->stopped || (!(data->nodes & 1023) && StopSearch(params)))
-    longjmp(thread->exit, 1);
+  // Either mainthread has ended us OR we've run out of time (or nodes)
+  // this second check is more expensive and done only every so often
+  if (data->nodes >= data->nextCheck && StopSearch(thread))
+    SetStopped(params, 1);
+  if (Stopped(params))
+    return 0;
 
   // draw check
   if (IsMaterialDraw(board) || IsRepetition(board, data->ply) || (board->halfMove > 99))
@@ -627,15 +875,18 @@ int Quiesce(int alpha, int beta, ThreadData* thread, PV* pv) {
     return Evaluate(board, thread);
 
   // check the transposition table for previous info
-  int ttHit = 0, ttScore = UNKNOWN;
-  TTEntry* tt = TTProbe(&ttHit, board->zobrist);
+  TTData tt;
+  int ttScore = UNKNOWN;
+  int ttHit = TTProbe(table, &tt, board->zobrist);
   // TT score pruning - no depth check required since everything in QS is depth 0
   if (ttHit) {
-    ttScore = TTScore(tt, data->ply);
+    ttScore = TTScore(&tt, data->ply);
 
-    if (ttScore != UNKNOWN && ((tt->flags & TT_EXACT) || ((tt->flags & TT_LOWER) && ttScore >= beta) ||
-                               ((tt->flags & TT_UPPER) && ttScore <= alpha)))
+    if (ttScore != UNKNOWN && ((tt.flags & TT_EXACT) || ((tt.flags & TT_LOWER) && ttScore >= beta) ||
+                               ((tt.flags & TT_UPPER) && ttScore <= alpha))) {
+      TT_STAT(cutoffs);
       return ttScore;
+    }
   }
 
   Move bestMove = NULL_MOVE;
@@ -643,18 +894,18 @@ int Quiesce(int alpha, int beta, ThreadData* thread, PV* pv) {
   int bestScore = -CHECKMATE + data->ply;
 
   // pull cached eval if it exists
-  int eval = data->evals[data->ply] = board->checkers ? UNKNOWN : (ttHit ? tt->eval : Evaluate(board, thread));
+  int eval = ss->eval = ss->inCheck ? UNKNOWN : (ttHit ? tt.eval : Evaluate(board, thread));
   if (!ttHit)
-    TTPut(board->zobrist, INT8_MIN, UNKNOWN, TT_UNKNOWN, NULL_MOVE, data->ply, eval);
+    TTPut(table, board->zobrist, INT8_MIN, UNKNOWN, TT_UNKNOWN, NULL_MOVE, data->ply, eval);
 
   // can we use an improved evaluation from the tt?
   if (ttHit && ttScore != UNKNOWN) {
-    if (tt->flags & (ttScore > eval ? TT_LOWER : TT_UPPER))
+    if (tt.flags & (ttScore > eval ? TT_LOWER : TT_UPPER))
       eval = ttScore;
   }
 
   // stand pat
-  if (!board->checkers) {
+  if (!ss->inCheck) {
     if (eval >= beta)
       return eval;
 
@@ -674,14 +925,19 @@ int Quiesce(int alpha, int beta, ThreadData* thread, PV* pv) {
     if (moves.phase > PLAY_GOOD_TACTICAL)
       break;
 
-    data->moves[data->ply++] = move;
+    PushMove(data, ss, move);
+    data->ply++;
     MakeMove(move, board);
+    TTPrefetch(table, board->zobrist);
 
-    int score = -Quiesce(-beta, -alpha, thread, &childPv);
+    int score = -Quiesce(-beta, -alpha, thread);
 
     UndoMove(move, board);
     data->ply--;
 
+    if (Stopped(params))
+      return 0;
+
     if (score > bestScore) {
       bestScore = score;
       bestMove = move;
@@ -689,10 +945,7 @@ int Quiesce(int alpha, int beta, ThreadData* thread, PV* pv) {
       if (score > alpha) {
         alpha = score;
 
-        // copy pv
-        pv->count = childPv.count + 1;
-        pv->moves[0] = move;
-        memcpy(pv->moves + 1, childPv.moves, childPv.count * sizeof(Move));
+        UpdatePV(data, move);
       }
 
       // failed high
@@ -702,19 +955,19 @@ int Quiesce(int alpha, int beta, ThreadData* thread, PV* pv) {
   }
 
   int TTFlag = bestScore >= beta ? TT_LOWER : bestScore <= origAlpha ? TT_UPPER : TT_EXACT;
-  TTPut(board->zobrist, 0, bestScore, TTFlag, bestMove, data->ply, data->evals[data->ply]);
+  TTPut(table, board->zobrist, 0, bestScore, TTFlag, bestMove, data->ply, ss->eval);
 
   return bestScore;
 }
 
 inline void PrintInfo(PV* pv, int score, ThreadData* thread, int alpha, int beta, int multiPV, Board* board) {
   int depth = thread->depth;
-  int seldepth = Seldepth(thread);
+  int seldepth = Seldepth(thread->threads);
   uint64_t nodes = NodesSearched(thread->threads);
   uint64_t tbhits = TBHits(thread->threads);
   uint64_t time = GetTimeMS() - thread->params->start;
   uint64_t nps = 1000 * nodes / max(time, 1);
-  int hashfull = TTFull();
+  int hashfull = TTFull(&thread->engine->tt);
   int bounded = max(alpha, min(beta, score));
 
   int printable = bounded >= MATE_BOUND    ? (CHECKMATE - bounded + 1) / 2
@@ -738,22 +991,3 @@ void PrintPV(PV* pv, Board* board) {
     printf("%s ", MoveToStr(pv->moves[i], board));
   printf("\n");
 }
-
-int MoveSearchedByMultiPV(ThreadData* thread, Move move) {
-  for (int i = 0; i < thread->multiPV; i++)
-    if (thread->bestMoves[i] == move)
-      return 1;
-
-  return 0;
-}
-
-int MoveSearchable(SearchParams* params, Move move) {
-  if (!params->searchMoves)
-    return 1;
-
-  for (int i = 0; i < params->searchable.count; i++)
-    if (move == params->searchable.moves[i])
-      return 1;
-
-  return 0;
-}
\ No newline at end of file
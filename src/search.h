@@ -27,14 +27,12 @@ void InitPruningAndReductionTables();
 
 void* UCISearch(void* arg);
 void BestMove(Board* board, SearchParams* params, ThreadData* threads, SearchResults* results);
+ThreadData* BestThread(ThreadData* threads);
 void* Search(void* arg);
-int Negamax(int alpha, int beta, int depth, ThreadData* thread, PV* pv);
-int Quiesce(int alpha, int beta, ThreadData* thread, PV* pv);
+int Negamax(int alpha, int beta, int depth, ThreadData* thread);
+int Quiesce(int alpha, int beta, ThreadData* thread);
 
 void PrintInfo(PV* pv, int score, ThreadData* thread, int alpha, int beta, int multiPV, Board* board);
 void PrintPV(PV* pv, Board* board);
- 
-int MoveSearchedByMultiPV(ThreadData* thread, Move move);
-int MoveSearchable(SearchParams* params, Move move);
 
 #endif
@@ -1,24 +1,158 @@
 
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "board.h"
 #include "eval.h"
+#include "numa.h"
 #include "types.h"
 #include "util.h"
 
-// initialize a pool of threads
-ThreadData* CreatePool(int count) {
-  ThreadData* threads = malloc(count * sizeof(ThreadData));
+typedef struct {
+  Engine* engine;
+  ThreadData* threads;
+  int count, first, next, started;
+  pthread_mutex_t mutex;
+  pthread_cond_t ready;
+} PoolStart;
+
+// A worker pins itself to its NUMA node and is the first to touch its ThreadData,
+// so the pages (history tables, pawn hash) are placed on that node. It then sleeps
+// until it is handed a job, runs it and goes back to sleep.
+void* PoolWorker(void* arg) {
+  PoolStart* start = (PoolStart*)arg;
+  int idx = __atomic_fetch_add(&start->next, 1, __ATOMIC_RELAXED);
+
+  NumaBindThread(start->first + idx);
+
+  ThreadData* thread = &start->threads[idx];
+  memset(thread, 0, sizeof(ThreadData));
+
+  // allow reference to one another
+  thread->idx = idx;
+  thread->engine = start->engine;
+  thread->threads = start->threads;
+  thread->count = start->count;
+  thread->nativeThread = pthread_self();
+  pthread_mutex_init(&thread->mutex, NULL);
+  pthread_cond_init(&thread->wake, NULL);
+
+  pthread_mutex_lock(&start->mutex);
+  start->started++;
+  pthread_cond_signal(&start->ready);
+  pthread_mutex_unlock(&start->mutex);
+
+  pthread_mutex_lock(&thread->mutex);
+  while (1) {
+    while (!thread->job && !thread->exiting)
+      pthread_cond_wait(&thread->wake, &thread->mutex);
+
+    if (!thread->job)
+      break;
+
+    pthread_mutex_unlock(&thread->mutex);
+    thread->job(thread->jobArg);
+    pthread_mutex_lock(&thread->mutex);
+
+    thread->job = NULL;
+    pthread_cond_broadcast(&thread->wake);
+  }
+  pthread_mutex_unlock(&thread->mutex);
+
+  return NULL;
+}
+
+// initialize a pool of threads searching for engine (NULL for a pool that never searches),
+// each with a worker that lives as long as the pool. Worker i is bound as thread first + i,
+// several pools of one (batch analysis) are spread over the nodes this way.
+// The array is left untouched here (an allocation this large is mapped fresh)
+// until every worker has set up its own entry.
+ThreadData* CreatePool(Engine* engine, int count, int first) {
+#if defined(_WIN32)
+  PoolStart start = {.threads = _aligned_malloc(count * sizeof(ThreadData), CACHE_LINE),
+                     .engine = engine,
+                     .count = count,
+                     .first = first};
+#else
+  PoolStart start = {.threads = aligned_alloc(CACHE_LINE, count * sizeof(ThreadData)),
+                     .engine = engine,
+                     .count = count,
+                     .first = first};
+#endif
+  pthread_mutex_init(&start.mutex, NULL);
+  pthread_cond_init(&start.ready, NULL);
 
   for (int i = 0; i < count; i++) {
-    // allow reference to one another
-    threads[i].idx = i;
-    threads[i].threads = threads;
-    threads[i].count = count;
+    pthread_t nativeThread;
+    pthread_create(&nativeThread, NULL, &PoolWorker, &start);
   }
 
-  return threads;
+  pthread_mutex_lock(&start.mutex);
+  while (start.started < count)
+    pthread_cond_wait(&start.ready, &start.mutex);
+  pthread_mutex_unlock(&start.mutex);
+
+  pthread_mutex_destroy(&start.mutex);
+  pthread_cond_destroy(&start.ready);
+
+  return start.threads;
+}
+
+// stop the workers once their current jobs finish, then release the pool
+void DestroyPool(ThreadData* threads) {
+  int count = threads->count;
+
+  for (int i = 0; i < count; i++) {
+    pthread_mutex_lock(&threads[i].mutex);
+    threads[i].exiting = 1;
+    pthread_cond_broadcast(&threads[i].wake);
+    pthread_mutex_unlock(&threads[i].mutex);
+  }
+
+  for (int i = 0; i < count; i++) {
+    pthread_join(threads[i].nativeThread, NULL);
+    pthread_mutex_destroy(&threads[i].mutex);
+    pthread_cond_destroy(&threads[i].wake);
+  }
+
+#if defined(_WIN32)
+  _aligned_free(threads);
+#else
+  free(threads);
+#endif
+}
+
+// hand a job to a thread's worker, after the one it is running (if any) completes
+void StartJob(ThreadData* thread, void* (*job)(void*), void* arg) {
+  pthread_mutex_lock(&thread->mutex);
+  while (thread->job)
+    pthread_cond_wait(&thread->wake, &thread->mutex);
+
+  thread->job = job;
+  thread->jobArg = arg;
+  pthread_cond_broadcast(&thread->wake);
+  pthread_mutex_unlock(&thread->mutex);
+}
+
+void WaitJob(ThreadData* thread) {
+  pthread_mutex_lock(&thread->mutex);
+  while (thread->job)
+    pthread_cond_wait(&thread->wake, &thread->mutex);
+  pthread_mutex_unlock(&thread->mutex);
+}
+
+// wake every helper on the same job with itself as the argument
+void StartHelpers(ThreadData* threads, void* (*job)(void*)) {
+  for (int i = 1; i < threads->count; i++)
+    StartJob(&threads[i], job, &threads[i]);
+}
+
+// completion barrier, returns once every helper is back asleep
+void WaitHelpers(ThreadData* threads) {
+  for (int i = 1; i < threads->count; i++)
+    WaitJob(&threads[i]);
 }
 
 // initialize a pool prepping to start a search
@@ -28,17 +162,23 @@ void InitPool(Board* board, SearchParams* params, ThreadData* threads, SearchRes
     threads[i].results = results;
 
     threads[i].data.nodes = 0;
+    threads[i].data.nextCheck = 0;
     threads[i].data.seldepth = 0;
     threads[i].data.ply = 0;
     threads[i].data.tbhits = 0;
+    threads[i].completedDepth = 0;
+
+#ifdef TT_STATS
+    memset(&threads[i].ttStats, 0, sizeof(TTStats));
+#endif
 
-    // empty unneeded data
-    memset(&threads[i].data.skipMove, 0, sizeof(threads[i].data.skipMove));
-    memset(&threads[i].data.evals, 0, sizeof(threads[i].data.evals));
-    memset(&threads[i].data.moves, 0, sizeof(threads[i].data.moves));
+    // empty unneeded data, only the killers are kept
+    SearchStack* stack = threads[i].data.stack;
+    for (int j = 0; j < STACK_SIZE; j++)
+      stack[j] = (SearchStack){.killers = {stack[j].killers[0], stack[j].killers[1]}};
 
-    // need full copies of the board
-    memcpy(&threads[i].board, board, sizeof(Board));
+    // the position and its repetition history, searches leave the rest as they found it
+    CopyBoard(&threads[i].board, board);
   }
 }
 
@@ -47,15 +187,13 @@ void ResetThreadPool(ThreadData* threads) {
     threads[i].results = NULL;
 
     threads[i].data.nodes = 0;
+    threads[i].data.nextCheck = 0;
     threads[i].data.seldepth = 0;
     threads[i].data.ply = 0;
     threads[i].data.tbhits = 0;
 
     // empty ALL data
-    memset(&threads[i].data.skipMove, 0, sizeof(threads[i].data.skipMove));
-    memset(&threads[i].data.evals, 0, sizeof(threads[i].data.evals));
-    memset(&threads[i].data.moves, 0, sizeof(threads[i].data.moves));
-    memset(&threads[i].data.killers, 0, sizeof(threads[i].data.killers));
+    memset(&threads[i].data.stack, 0, sizeof(threads[i].data.stack));
     memset(&threads[i].data.counters, 0, sizeof(threads[i].data.counters));
     memset(&threads[i].data.hh, 0, sizeof(threads[i].data.hh));
     memset(&threads[i].pawnHashTable, 0, PAWN_TABLE_SIZE * sizeof(PawnHashEntry));
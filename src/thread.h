@@ -5,7 +5,12 @@
 
 #include "types.h"
 
-ThreadData* CreatePool(int count);
+ThreadData* CreatePool(Engine* engine, int count, int first);
+void DestroyPool(ThreadData* threads);
+void StartJob(ThreadData* thread, void* (*job)(void*), void* arg);
+void WaitJob(ThreadData* thread);
+void StartHelpers(ThreadData* threads, void* (*job)(void*));
+void WaitHelpers(ThreadData* threads);
 void InitPool(Board* board, SearchParams* params, ThreadData* threads, SearchResults* results);
 void ResetThreadPool(ThreadData* threads);
 uint64_t NodesSearched(ThreadData* threads);
@@ -0,0 +1,77 @@
+
+
+#include <math.h>
+
+#include "timeman.h"
+#include "types.h"
+#include "util.h"
+
+// expected time to depth growth, clamped from the last two depths
+#define MIN_BRANCHING 1.5
+#define MAX_BRANCHING 4.0
+
+// time is what is left after the move overhead
+void TMSetClock(SearchParams* params, int time, int inc, int movesToGo) {
+  int optimum = max(1, time / movesToGo + inc);
+
+  // the hard limit keeps a quarter of the clock back, at fast controls that is what avoids flagging
+  params->hardLimit = min(4 * optimum, time * 3 / 4);
+  params->softLimit = min(optimum, params->hardLimit / 2);
+}
+
+void TMInit(TimeManager* tm, SearchParams* params) {
+  *tm = (TimeManager){.soft = params->softLimit};
+}
+
+void TMStartDepth(TimeManager* tm) {
+  tm->failLows = tm->failHighs = 0;
+  tm->depthStart = GetTimeMS();
+}
+
+// whether the main thread should stop after completing depth, its root moves are sorted by then
+int TMStopAfterDepth(TimeManager* tm, ThreadData* thread, int depth) {
+  SearchParams* params = thread->params;
+  long now = GetTimeMS();
+
+  Move bestMove = thread->rootMoves[0].move;
+  int score = thread->scores[0];
+  int scoreDrop = tm->score - score;
+
+  tm->stability = bestMove == tm->bestMove ? min(tm->stability + 1, 8) : 0;
+  tm->bestMove = bestMove;
+  tm->score = score;
+
+  tm->prevDepthTime = tm->lastDepthTime;
+  tm->lastDepthTime = now - tm->depthStart;
+
+  // movetime is spent as given
+  if (!params->timeset || params->softLimit >= params->hardLimit)
+    return 0;
+
+  if (depth >= 5) {
+    // a best move that keeps changing needs time, one that has held for a while does not
+    double stability = 1.4 - 0.1 * tm->stability;
+
+    // so does a falling score, a rising one a little less
+    double trend = fmin(1.5, fmax(0.9, 1 + scoreDrop / 100.0));
+
+    // failing low at the root means the best move is in trouble, failing high that it is being replaced
+    double fails = fmin(1.6, 1 + 0.15 * tm->failLows + 0.05 * tm->failHighs);
+
+    // the best move taking most of the nodes is unlikely to change
+    double share = (double)thread->rootMoves[0].nodes / max(1, thread->data.nodes);
+    double effort = fmax(0.5, 2.4 - 2 * share);
+
+    tm->soft = min(params->hardLimit, params->softLimit * stability * trend * fails * effort);
+  }
+
+  long elapsed = now - params->start;
+  if (elapsed >= tm->soft)
+    return 1;
+
+  // the next depth takes about the last one times the branching factor, do not start it if it cannot finish
+  double branching = tm->prevDepthTime > 0 ? (double)tm->lastDepthTime / tm->prevDepthTime : 2.0;
+  branching = fmin(MAX_BRANCHING, fmax(MIN_BRANCHING, branching));
+
+  return elapsed + tm->lastDepthTime * branching > params->hardLimit;
+}
@@ -0,0 +1,29 @@
+
+
+#ifndef TIMEMAN_H
+#define TIMEMAN_H
+
+#include "types.h"
+
+// The main thread's view of the clock over one search. go sets a soft and a
+// hard limit in the params. Every thread stops at the hard limit wherever it
+// is, the soft limit is only looked at between depths, scaled by how settled
+// the search is, and a depth that is not expected to finish before the hard
+// limit is not started (a depth cut short is thrown away).
+typedef struct {
+  int soft;                          // the soft limit as scaled so far
+  Move bestMove;                     // of the last completed depth
+  int stability;                     // depths in a row it has stayed best
+  int score;                         // of the last completed depth
+  int failLows, failHighs;           // root re-searches in the current depth
+  long depthStart;                   //
+  long lastDepthTime, prevDepthTime; // of the last two completed depths, ms
+} TimeManager;
+
+void TMSetClock(SearchParams* params, int time, int inc, int movesToGo);
+
+void TMInit(TimeManager* tm, SearchParams* params);
+void TMStartDepth(TimeManager* tm);
+int TMStopAfterDepth(TimeManager* tm, ThreadData* thread, int depth);
+
+#endif
@@ -1,77 +1,854 @@
 
 
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
-#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
-#if defined(__linux__)
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
 #include <sys/mman.h>
+#include <unistd.h>
 #endif
 
 #include "bits.h"
+#include "board.h"
+#include "move.h"
+#include "numa.h"
 #include "search.h"
+#include "thread.h"
 #include "transposition.h"
 #include "types.h"
+#include "util.h"
+
+#ifdef TT_STATS
+__thread TTStats* ttStats = NULL;
+#endif
+
+enum { TT_ALLOC_FAILED, TT_ALLOC_FRESH, TT_ALLOC_RESUMED };
+
+#define TT_ATTACH_ATTEMPTS 8      // to attach to a SharedHash segment others are attaching to or leaving
+#define TT_ATTACH_RETRY_US 10000 // between them
+
+void TTRehash(TTTable* tt, TTTable* from, ThreadData* threads);
+void TTRelease(TTTable* table);
+
+TTFileHeader TTFileHeaderFor(TTTable* tt, uint64_t count) {
+  return (TTFileHeader){
+      .magic = TT_FILE_MAGIC, .entrySize = sizeof(TTEntry), .bucketSize = BUCKET_SIZE, .count = count, .age = tt->age};
+}
 
-// Global TT
-TTTable TT = {0};
+int TTFileHeaderValid(TTFileHeader* header) {
+  return header->magic == TT_FILE_MAGIC && header->entrySize == sizeof(TTEntry) && header->bucketSize == BUCKET_SIZE;
+}
+
+#if !defined(_WIN32)
+int TTHolds(int fd, uint64_t count, TTFileHeader* header) {
+  return pread(fd, header, sizeof(*header), 0) == sizeof(*header) && TTFileHeaderValid(header) && header->count == count;
+}
+
+// Map count buckets from a file or shared memory object. A resumed table keeps its
+// contents and age, a fresh one (already zeroed, being newly sized) gets a header.
+int TTMapFd(TTTable* tt, int fd, uint64_t count, int mem, TTFileHeader* resumed) {
+  uint64_t bytes = TT_FILE_HEADER + count * sizeof(TTBucket);
+  void* mapping = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED)
+    return TT_ALLOC_FAILED;
 
-size_t TTInit(int mb) {
-  if (TT.mask)
-    TTFree();
+  tt->mem = mem;
+  tt->pages = TT_PAGES_NORMAL;
+  tt->mapped = bytes;
+  tt->header = mapping;
+  tt->buckets = (TTBucket*)((char*)mapping + TT_FILE_HEADER);
+  tt->count = count;
+  tt->size = count * sizeof(TTBucket);
+
+  if (resumed) {
+    tt->age = resumed->age & TT_AGE_MASK;
+    return TT_ALLOC_RESUMED;
+  }
+
+  *tt->header = TTFileHeaderFor(tt, count);
+  return TT_ALLOC_FRESH;
+}
 
-  uint64_t keySize = (uint64_t)log2(mb) + (uint64_t)log2(MEGABYTE / sizeof(TTBucket));
+// whether name still refers to the object open on fd
+int TTSameObject(int fd, char* name) {
+  int current = shm_open(name, O_RDWR, 0);
+  if (current < 0)
+    return 0;
+
+  struct stat a, b;
+  int same = !fstat(fd, &a) && !fstat(current, &b) && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+  close(current);
+  return same;
+}
+#endif
+
+// Back the table with a shared mapping of tt->file. A file holding a table is picked
+// up as it is, at its own size whatever Hash is set to, and a new (empty) file becomes
+// an empty table of this size. Any other file is refused, never replaced.
+int TTMapFile(TTTable* tt, uint64_t count) {
+#if defined(_WIN32)
+  (void)count;
+  printf("info string HashFile is not supported on this platform\n");
+  return TT_ALLOC_FAILED;
+#else
+  int fd = open(tt->file, O_RDWR | O_CREAT, 0644);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st)) {
+    printf("info string failed to open HashFile %s\n", tt->file);
+    if (fd >= 0)
+      close(fd);
+    return TT_ALLOC_FAILED;
+  }
+
+  TTFileHeader header;
+  int warm = st.st_size > 0;
+
+  if (!warm) {
+    // a new sparse file reads back as an empty table
+    if (ftruncate(fd, TT_FILE_HEADER + count * sizeof(TTBucket))) {
+      printf("info string failed to create HashFile %s\n", tt->file);
+      close(fd);
+      return TT_ALLOC_FAILED;
+    }
+  } else if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || !TTFileHeaderValid(&header) || !header.count ||
+             header.count > TT_MAX_MB * MEGABYTE / sizeof(TTBucket) ||
+             (uint64_t)st.st_size < TT_FILE_HEADER + header.count * sizeof(TTBucket)) {
+    printf("info string HashFile %s is not a table for this build, it is left as it is\n", tt->file);
+    close(fd);
+    return TT_ALLOC_FAILED;
+  } else if (header.count != count) {
+    printf("info string HashFile %s holds a %" PRIu64 " MB table, Hash follows it\n", tt->file,
+           (uint64_t)(header.count * sizeof(TTBucket) / MEGABYTE));
+    count = header.count;
+  }
+
+  int mapped = TTMapFd(tt, fd, count, TT_MEM_FILE, warm ? &header : NULL);
+  close(fd);
+
+  if (!mapped)
+    printf("info string failed to map HashFile %s\n", tt->file);
+  else if (warm)
+    printf("info string resuming the table in HashFile %s\n", tt->file);
+
+  return mapped;
+#endif
+}
+
+// Attach to the shared memory segment tt->shm, creating it if needed. Every attached
+// process holds a shared flock on the segment, the kernel drops it however the process
+// ends, so the last one out can tell it is alone and remove the segment. A segment left
+// behind by a killed process is resumed by the next one to attach.
+// Its creator sizes it under a blocking exclusive lock, so anyone opening it meanwhile
+// waits for the table. A segment of another size is only resized by a process that
+// finds itself alone on it, and since a failed flock upgrade drops the shared lock on
+// Linux, the shared lock is let go first and the attach is retried a few times.
+int TTMapShared(TTTable* tt, uint64_t count) {
+#if defined(_WIN32)
+  (void)count;
+  printf("info string SharedHash is not supported on this platform\n");
+  return TT_ALLOC_FAILED;
+#else
+  uint64_t bytes = TT_FILE_HEADER + count * sizeof(TTBucket);
+  int busy = 0;
+
+  for (int attempt = 0; attempt < TT_ATTACH_ATTEMPTS; attempt++) {
+    if (attempt)
+      usleep(TT_ATTACH_RETRY_US);
+
+    int fd = shm_open(tt->shm, O_RDWR | O_CREAT | O_EXCL, 0600);
+    int created = fd >= 0;
+    if (!created && errno == EEXIST)
+      fd = shm_open(tt->shm, O_RDWR, 0);
+
+    // removed by the last process detaching before it could be opened
+    if (fd < 0 && errno == ENOENT)
+      continue;
+
+    if (fd < 0) {
+      printf("info string failed to open SharedHash %s\n", tt->shm);
+      return TT_ALLOC_FAILED;
+    }
+
+    // the last process detaching may have removed it before the lock was granted
+    if (flock(fd, created ? LOCK_EX : LOCK_SH) || !TTSameObject(fd, tt->shm)) {
+      close(fd);
+      continue;
+    }
+
+    TTFileHeader header;
+    int mapped = TT_ALLOC_FAILED;
+
+    if (created) {
+      if (!ftruncate(fd, bytes))
+        mapped = TTMapFd(tt, fd, count, TT_MEM_SHARED, NULL);
+    } else if (TTHolds(fd, count, &header)) {
+      mapped = TTMapFd(tt, fd, count, TT_MEM_SHARED, &header);
+    } else {
+      // another size or format, or an empty one its creator is about to size (or was
+      // killed before sizing, which is only assumed once the attempts run out)
+      struct stat st;
+      int empty = !fstat(fd, &st) && st.st_size == 0;
+
+      flock(fd, LOCK_UN);
+      if ((empty && attempt < TT_ATTACH_ATTEMPTS - 1) || flock(fd, LOCK_EX | LOCK_NB) || !TTSameObject(fd, tt->shm)) {
+        busy = !empty;
+        close(fd);
+        continue;
+      }
+
+      // alone on it, though it may have been sized for this table in the meantime
+      if (TTHolds(fd, count, &header))
+        mapped = TTMapFd(tt, fd, count, TT_MEM_SHARED, &header);
+      else if (!ftruncate(fd, 0) && !ftruncate(fd, bytes))
+        mapped = TTMapFd(tt, fd, count, TT_MEM_SHARED, NULL);
+    }
+
+    if (!mapped) {
+      close(fd);
+      return TT_ALLOC_FAILED;
+    }
+
+    flock(fd, LOCK_SH);
+    tt->fd = fd;
+    return mapped;
+  }
+
+  if (busy)
+    printf("info string SharedHash %s is in use with another Hash size or format\n", tt->shm);
+  else
+    printf("info string failed to attach to SharedHash %s\n", tt->shm);
+  return TT_ALLOC_FAILED;
+#endif
+}
 
 #if defined(__linux__) && !defined(__ANDROID__)
-  // On Linux systems we align on 2MB boundaries and request Huge Pages
-  TT.buckets = aligned_alloc(2 * MEGABYTE, (1ULL << keySize) * sizeof(TTBucket));
-  madvise(TT.buckets, (1ULL << keySize) * sizeof(TTBucket), MADV_HUGEPAGE);
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+// Explicit hugetlb pages from the kernel's reserved pool, 1GB first and then 2MB.
+// The mapping is rounded up to whole pages, unless that wastes more than an eighth.
+int TTMapHugeTLB(TTTable* tt, uint64_t size) {
+  const int shifts[] = {30, 21};
+  const int pages[] = {TT_PAGES_1GB, TT_PAGES_2MB};
+
+  for (int i = 0; i < 2; i++) {
+    uint64_t page = 1ULL << shifts[i];
+    uint64_t bytes = (size + page - 1) & ~(page - 1);
+    if (bytes - size > size / 8)
+      continue;
+
+    void* mapping = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shifts[i] << MAP_HUGE_SHIFT), -1, 0);
+    if (mapping == MAP_FAILED)
+      continue;
+
+    tt->mem = TT_MEM_HUGETLB;
+    tt->pages = pages[i];
+    tt->mapped = bytes;
+    tt->buckets = mapping;
+    return 1;
+  }
+
+  return 0;
+}
+
+// madvise is only a hint, look up how much of the table's mapping THP really backs
+uint64_t TTTransparentHugeBytes(TTTable* tt) {
+  FILE* fp = fopen("/proc/self/smaps", "r");
+  if (!fp)
+    return 0;
+
+  char line[256];
+  uint64_t lo, hi, kb = 0, addr = (uintptr_t)tt->buckets;
+  int inside = 0;
+
+  while (fgets(line, sizeof(line), fp)) {
+    if (sscanf(line, "%" SCNx64 "-%" SCNx64, &lo, &hi) == 2)
+      inside = lo <= addr && addr < hi;
+    else if (inside && sscanf(line, "AnonHugePages: %" SCNu64, &kb) == 1)
+      break;
+  }
+
+  fclose(fp);
+  return kb * 1024;
+}
+#endif
+
+// Place a table of size bytes, from the SharedHash segment or the HashFile when one is set, otherwise in anonymous
+// memory on the largest pages available. Nothing is cleared here.
+int TTAllocate(TTTable* tt, uint64_t size) {
+  if (tt->shm[0]) {
+    int mapped = TTMapShared(tt, size / sizeof(TTBucket));
+    if (mapped)
+      return mapped;
+  } else if (tt->file[0]) {
+    int mapped = TTMapFile(tt, size / sizeof(TTBucket));
+    if (mapped)
+      return mapped;
+  }
+
+  tt->mem = TT_MEM_HEAP;
+  tt->pages = TT_PAGES_NORMAL;
+  tt->header = NULL;
+
+#if defined(__linux__) && !defined(__ANDROID__)
+  // On Linux systems we try hugetlb pages, then align on 2MB boundaries and request Huge Pages
+  if (!TTMapHugeTLB(tt, size)) {
+    tt->buckets = aligned_alloc(2 * MEGABYTE, size);
+    if (tt->buckets)
+      madvise(tt->buckets, size, MADV_HUGEPAGE);
+  }
+#elif defined(_WIN32)
+  tt->buckets = _aligned_malloc(size, 64);
+#else
+  tt->buckets = aligned_alloc(64, size);
+#endif
+
+  if (!tt->buckets)
+    return TT_ALLOC_FAILED;
+
+  // every thread probes everywhere, so no node should hold more of it than the others
+  NumaInterleave(tt->buckets, size);
+
+  tt->count = size / sizeof(TTBucket);
+  tt->size = tt->count * sizeof(TTBucket);
+  return TT_ALLOC_FRESH;
+}
+
+size_t TTInit(TTTable* tt, int mb, ThreadData* threads) {
+  // a shared segment is not ours to rehash, detaching first lets it be resized
+  if (tt->mem == TT_MEM_SHARED)
+    TTFree(tt);
+
+  // the current table stays around until its entries are moved over
+  TTTable old = *tt;
+  tt->buckets = NULL;
+  tt->header = NULL;
+#ifdef TT_STATS
+  tt->hashes = NULL;
+#endif
+
+  // any size is honored, buckets are picked by a multiply-high of the hash
+  uint64_t size = mb * MEGABYTE;
+  int allocated = TTAllocate(tt, size);
+
+  // both tables don't fit at once, so the old entries have to go
+  if (!allocated && old.buckets) {
+    printf("info string not enough memory to keep the Hash entries while resizing\n");
+    TTRelease(&old);
+    allocated = TTAllocate(tt, size);
+  }
+
+  if (!allocated) {
+    printf("info string failed to allocate %d MB for Hash\n", mb);
+    exit(EXIT_FAILURE);
+  }
+
+#ifdef TT_STATS
+  // 8 bytes a slot, a table too big to shadow is counted without collisions
+  tt->hashes = calloc(tt->count * BUCKET_SIZE, sizeof(uint64_t));
+  if (!tt->hashes)
+    printf("info string not enough memory to track TT collisions for %d MB of Hash\n", mb);
+#endif
+
+  if (allocated == TT_ALLOC_FRESH) {
+    if (old.buckets)
+      TTRehash(tt, &old, threads);
+    else
+      TTClear(tt, threads);
+  }
+
+  TTRelease(&old);
+  tt->fullTime = 0;
+
+#if defined(__linux__) && !defined(__ANDROID__)
+  // every page has been faulted in by now, so THP has had its chance
+  if (tt->mem == TT_MEM_HEAP && TTTransparentHugeBytes(tt))
+    tt->pages = TT_PAGES_THP;
+#endif
+
+  // the table on normal pages is kept and the option refused, a setoption must not end the engine
+  if (tt->requireLargePages && !tt->header && tt->pages == TT_PAGES_NORMAL) {
+    printf("info string failed to get large pages for %d MB of Hash, RequireLargePages is off\n", mb);
+    tt->requireLargePages = 0;
+  }
+
+  return tt->size;
+}
+
+const char* TTPagesName(TTTable* tt) {
+  static const char* names[] = {"normal pages", "transparent huge pages", "2MB huge pages", "1GB huge pages"};
+  return names[tt->pages];
+}
+
+void TTRelease(TTTable* table) {
+  if (!table->buckets)
+    return;
+
+#if defined(_WIN32)
+  _aligned_free(table->buckets);
+#else
+  if (table->mem == TT_MEM_FILE) {
+    munmap(table->header, table->mapped);
+  } else if (table->mem == TT_MEM_SHARED) {
+    munmap(table->header, table->mapped);
+
+    // the last process out removes the segment, unless the name was reused meanwhile
+    if (!flock(table->fd, LOCK_EX | LOCK_NB) && TTSameObject(table->fd, table->shm))
+      shm_unlink(table->shm);
+    close(table->fd);
+  } else if (table->mem == TT_MEM_HUGETLB) {
+    munmap(table->buckets, table->mapped);
+  } else {
+    free(table->buckets);
+  }
+#endif
+  table->buckets = NULL;
+  table->header = NULL;
+
+#ifdef TT_STATS
+  free(table->hashes);
+  table->hashes = NULL;
+#endif
+}
+
+void TTFree(TTTable* tt) { TTRelease(tt); }
+
+// Write the table out as a header followed by the raw buckets
+int TTSave(TTTable* tt, char* path) {
+#if !defined(_WIN32)
+  // a table mapped from this file only has to be flushed
+  if (tt->mem == TT_MEM_FILE && !strcmp(path, tt->file))
+    return !msync(tt->header, TT_FILE_HEADER + tt->size, MS_SYNC);
+#endif
+
+  FILE* fp = fopen(path, "wb");
+  if (!fp)
+    return 0;
+
+  char header[TT_FILE_HEADER] = {0};
+  TTFileHeader h = TTFileHeaderFor(tt, tt->count);
+  memcpy(header, &h, sizeof(h));
+
+  int saved = fwrite(header, 1, TT_FILE_HEADER, fp) == TT_FILE_HEADER && fwrite(tt->buckets, 1, tt->size, fp) == tt->size;
+  return !fclose(fp) && saved;
+}
+
+// Read a saved table back in, resizing the Hash to match it. The file is checked
+// against its header before anything is resized, a file that fails leaves the table as it was
+int TTLoad(TTTable* tt, char* path, ThreadData* threads) {
+  if (tt->mem == TT_MEM_FILE && !strcmp(path, tt->file))
+    return 1;
+
+  FILE* fp = fopen(path, "rb");
+  if (!fp)
+    return 0;
+
+  TTFileHeader header;
+  uint64_t size = 0;
+  if (fread(&header, sizeof(header), 1, fp) == 1 && TTFileHeaderValid(&header) &&
+      header.count <= TT_MAX_MB * MEGABYTE / sizeof(TTBucket))
+    size = header.count * sizeof(TTBucket);
+
+  // a truncated file is refused here, not half loaded
+  struct stat st;
+  uint64_t bytes = TT_FILE_HEADER + size;
+  if (!size || size % MEGABYTE || fstat(fileno(fp), &st) || (uint64_t)st.st_size < bytes) {
+    fclose(fp);
+    return 0;
+  }
+
+#if defined(_WIN32)
+  if (fseek(fp, TT_FILE_HEADER, SEEK_SET)) {
+    fclose(fp);
+    return 0;
+  }
+#else
+  // copy straight out of the page cache rather than through stdio buffers
+  void* mapping = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+  if (mapping == MAP_FAILED) {
+    fclose(fp);
+    return 0;
+  }
+#endif
+
+  // nothing worth rehashing, the whole table is about to be overwritten
+  if (header.count != tt->count) {
+    TTFree(tt);
+    TTInit(tt, size / MEGABYTE, threads);
+  }
+
+  int loaded;
+#if defined(_WIN32)
+  loaded = fread(tt->buckets, 1, size, fp) == size;
 #else
-  TT.buckets = calloc((1ULL << keySize), sizeof(TTBucket));
+  madvise(mapping, bytes, MADV_SEQUENTIAL);
+  memcpy(tt->buckets, (char*)mapping + TT_FILE_HEADER, size);
+  munmap(mapping, bytes);
+  loaded = 1;
 #endif
+  fclose(fp);
+
+  // only a read error after the size was checked gets here
+  if (!loaded) {
+    TTClear(tt, threads);
+    return 0;
+  }
 
-  TT.mask = (1ULL << keySize) - 1ULL;
+  tt->age = header.age;
+  if (tt->header)
+    tt->header->age = tt->age;
 
-  TTClear();
-  return (TT.mask + 1ULL) * sizeof(TTBucket);
+#ifdef TT_STATS
+  // loaded entries have no known hash, so they never count as collisions
+  if (tt->hashes)
+    memset(tt->hashes, 0, tt->count * BUCKET_SIZE * sizeof(uint64_t));
+#endif
+
+  return 1;
 }
 
-void TTFree() { free(TT.buckets); }
+typedef struct {
+  int idx, count;
+  TTTable* tt;   // the table being filled
+  TTTable* from; // the table being rehashed
+} TTJob;
 
-inline void TTClear() { memset(TT.buckets, 0, (TT.mask + 1ULL) * sizeof(TTBucket)); }
+// whole 2MB pages per thread, so each huge page is first touched by one thread only
+INLINE void TTJobSlice(TTJob* job, uint64_t* start, uint64_t* end) {
+  TTTable* tt = job->tt;
+  uint64_t slice = (tt->size + job->count - 1) / job->count;
+  slice = (slice + 2 * MEGABYTE - 1) & ~(2 * MEGABYTE - 1);
+
+  *start = min(tt->size, slice * job->idx);
+  *end = min(tt->size, *start + slice);
+}
 
-inline void TTUpdate() { TT.age += 1; }
+// every worker of the pool takes a slice, the caller only waits for them,
+// without a pool (the stress test) the caller does the whole table
+void TTRunJobs(void* (*part)(void*), TTTable* tt, TTTable* from, ThreadData* threads) {
+  int count = threads ? threads->count : 1;
+  TTJob jobs[count];
 
-inline int TTScore(TTEntry* e, int ply) {
+  for (int i = 0; i < count; i++)
+    jobs[i] = (TTJob){.idx = i, .count = count, .tt = tt, .from = from};
+
+  if (!threads) {
+    part(&jobs[0]);
+    return;
+  }
+
+  for (int i = 0; i < count; i++)
+    StartJob(&threads[i], part, &jobs[i]);
+  for (int i = 0; i < count; i++)
+    WaitJob(&threads[i]);
+}
+
+void* TTClearPart(void* arg) {
+  TTJob* job = (TTJob*)arg;
+
+  uint64_t start, end;
+  TTJobSlice(job, &start, &end);
+  memset((char*)job->tt->buckets + start, 0, end - start);
+
+  return NULL;
+}
+
+// split the clear across the pool, this is also the first touch of the table
+// so on NUMA systems the pages end up spread over the nodes the workers are bound to
+void TTClear(TTTable* tt, ThreadData* threads) {
+  TTRunJobs(&TTClearPart, tt, NULL, threads);
+  tt->fullTime = 0;
+
+#ifdef TT_STATS
+  if (tt->hashes)
+    memset(tt->hashes, 0, tt->count * BUCKET_SIZE * sizeof(uint64_t));
+#endif
+}
+
+// A mapped table keeps its age in the header, where a restart or the other processes
+// sharing it pick it up. It moves on once per generation, not once per go in every
+// attached process (N engines would age each other's entries N times as fast): only
+// an engine still on the header's age advances it, the others catch up to it.
+inline void TTUpdate(TTTable* tt) {
+  if (!tt->header) {
+    tt->age = (tt->age + 1) & TT_AGE_MASK;
+    return;
+  }
+
+  uint8_t age = __atomic_load_n(&tt->header->age, __ATOMIC_RELAXED);
+  if ((age & TT_AGE_MASK) == tt->age &&
+      __atomic_compare_exchange_n(&tt->header->age, &age, age + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    age++;
+
+  tt->age = age & TT_AGE_MASK;
+}
+
+inline int TTScore(TTData* e, int ply) {
   if (e->score == UNKNOWN)
     return UNKNOWN;
 
   return e->score > MATE_BOUND ? e->score - ply : e->score < -MATE_BOUND ? e->score + ply : e->score;
 }
 
-inline void TTPrefetch(uint64_t hash) { __builtin_prefetch(&TT.buckets[TT.mask & hash]); }
+Move TTMove(TTData* e, Board* board) {
+#ifdef TT_PACKED
+  int start = e->move & 0x3F;
+  int end = (e->move >> 6) & 0x3F;
+  int piece = board->squares[start];
 
-inline TTEntry* TTProbe(int* hit, uint64_t hash) {
-  TTEntry* bucket = TT.buckets[TT.mask & hash].entries;
-  uint32_t shortHash = hash >> 32;
+  if (!e->move || piece == NO_PIECE)
+    return NULL_MOVE;
 
-  for (int i = 0; i < BUCKET_SIZE; i++)
-    if (bucket[i].hash == shortHash) {
-      *hit = 1;
-      bucket[i].age = TT.age;
-      return &bucket[i];
+  int castle = e->move >> 14 == 2;
+  int promo = e->move >> 14 == 1 ? 2 * (KNIGHT_TYPE + ((e->move >> 12) & 0x3)) + (piece & 1) : 0;
+  int pawn = PIECE_TYPE[piece] == PAWN_TYPE;
+  int ep = pawn && board->epSquare && end == board->epSquare && file(start) != file(end);
+  int capture = !castle && (ep || board->squares[end] != NO_PIECE);
+
+  // anything nonsensical is caught by MoveIsLegal before it is played
+  return BuildMove(start, end, piece, promo, capture, pawn && abs(start - end) == 16, ep, castle);
+#else
+  (void)board;
+  return e->move;
+#endif
+}
+
+// maps the hash uniformly onto [0, count) without needing a power of two
+INLINE uint64_t TTIndex(TTTable* tt, uint64_t hash) { return ((unsigned __int128)hash * tt->count) >> 64; }
+
+inline void TTPrefetch(TTTable* tt, uint64_t hash) { __builtin_prefetch(&tt->buckets[TTIndex(tt, hash)]); }
+
+#ifdef TT_PACKED
+_Static_assert(sizeof(TTEntry) == 10, "packed TT entries must be 10 bytes");
+_Static_assert(sizeof(TTBucket) == 32, "packed TT buckets must be 32 bytes");
+
+// hash bits used to verify an entry, the high bits already picked the bucket
+INLINE uint32_t TTKey(uint64_t hash) { return (uint16_t)hash; }
+
+INLINE uint16_t TTRotate(uint16_t v, int s) { return v << s | v >> (16 - s); }
+
+// rotating each field keeps simple differences between two writes from cancelling out
+INLINE uint16_t TTFold(uint16_t move, int16_t score, int16_t eval, int8_t depth, uint8_t flags) {
+  return move ^ TTRotate(score, 5) ^ TTRotate(eval, 11) ^ ((uint8_t)depth << 8 | flags);
+}
+
+INLINE uint16_t TTCompactMove(Move move) {
+  if (MoveCastle(move))
+    return MoveStartEnd(move) | 2 << 14;
+
+  if (MovePromo(move))
+    return MoveStartEnd(move) | (PIECE_TYPE[MovePromo(move)] - KNIGHT_TYPE) << 12 | 1 << 14;
+
+  return MoveStartEnd(move);
+}
+
+// copy an entry out field by field, returning the hash bits it verifies against
+INLINE uint32_t TTRead(TTEntry* entry, TTData* e) {
+  uint16_t key = __atomic_load_n(&entry->key, __ATOMIC_RELAXED);
+  uint8_t ageFlags = __atomic_load_n(&entry->ageFlags, __ATOMIC_RELAXED);
+
+  e->move = __atomic_load_n(&entry->move, __ATOMIC_RELAXED);
+  e->score = __atomic_load_n(&entry->score, __ATOMIC_RELAXED);
+  e->eval = __atomic_load_n(&entry->eval, __ATOMIC_RELAXED);
+  e->depth = __atomic_load_n(&entry->depth, __ATOMIC_RELAXED);
+  e->flags = ageFlags & 0x7;
+  e->age = ageFlags >> 3;
+
+  return key ^ TTFold(e->move, e->score, e->eval, e->depth, e->flags);
+}
+
+INLINE void TTWrite(TTEntry* entry, uint32_t hashKey, TTData* e) {
+  uint16_t move = TTCompactMove(e->move);
+  uint16_t key = hashKey ^ TTFold(move, e->score, e->eval, e->depth, e->flags);
+
+  __atomic_store_n(&entry->move, move, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry->score, e->score, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry->eval, e->eval, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry->depth, e->depth, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry->ageFlags, e->age << 3 | e->flags, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry->key, key, __ATOMIC_RELAXED);
+}
+
+// refresh the age in place, if another thread replaced the entry meanwhile we leave theirs alone
+INLINE void TTTouch(TTEntry* entry, uint8_t age) {
+  uint8_t ageFlags = __atomic_load_n(&entry->ageFlags, __ATOMIC_RELAXED);
+  __atomic_compare_exchange_n(&entry->ageFlags, &ageFlags, age << 3 | (ageFlags & 0x7), 0, __ATOMIC_RELAXED,
+                              __ATOMIC_RELAXED);
+}
+#else
+_Static_assert(sizeof(TTBucket) == 64, "TT buckets must fill a cache line");
+
+// hash bits used to verify an entry, the high bits already picked the bucket
+INLINE uint32_t TTKey(uint64_t hash) { return (uint32_t)hash; }
+
+INLINE uint32_t TTFold(uint64_t data) { return (uint32_t)data ^ (uint32_t)(data >> 32); }
+
+// copy an entry out with one load per word, returning the hash bits it verifies against
+INLINE uint32_t TTRead(TTEntry* entry, TTData* e) {
+  uint64_t key = __atomic_load_n(&entry->key, __ATOMIC_RELAXED);
+  uint64_t data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+
+  e->move = (Move)data;
+  e->score = (int16_t)(data >> 32);
+  e->eval = (int16_t)(data >> 48);
+  e->depth = (int8_t)(key >> 16);
+  e->flags = (uint8_t)(key >> 8);
+  e->age = (uint8_t)key;
+
+  return (key >> 32) ^ TTFold(data);
+}
+
+INLINE void TTWrite(TTEntry* entry, uint32_t hashKey, TTData* e) {
+  uint64_t data = (uint64_t)e->move | (uint64_t)(uint16_t)e->score << 32 | (uint64_t)(uint16_t)e->eval << 48;
+  uint64_t key = (uint64_t)(hashKey ^ TTFold(data)) << 32 | (uint64_t)(uint8_t)e->depth << 16 |
+                 (uint64_t)e->flags << 8 | e->age;
+
+  __atomic_store_n(&entry->data, data, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry->key, key, __ATOMIC_RELAXED);
+}
+
+// refresh the age in place, if another thread replaced the entry meanwhile we leave theirs alone
+INLINE void TTTouch(TTEntry* entry, uint8_t age) {
+  uint64_t key = __atomic_load_n(&entry->key, __ATOMIC_RELAXED);
+  __atomic_compare_exchange_n(&entry->key, &key, (key & ~0xFFULL) | age, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+#endif
+
+INLINE int TTEmpty(TTData* e) { return !e->depth && !e->flags && !e->age; }
+
+INLINE int TTAgeDiff(TTTable* tt, TTData* e) { return (tt->age - e->age) & TT_AGE_MASK; }
+
+// entries of the current search first, then the deepest
+INLINE int TTKeepValue(TTTable* tt, TTData* e) { return (!TTAgeDiff(tt, e) << 8) + e->depth + 128; }
+
+// whether the hashes of old bucket i land in more than one bucket of the new table
+INLINE int TTSpreads(TTTable* tt, TTTable* from, uint64_t i) {
+  unsigned __int128 lo = (((unsigned __int128)i << 64) + from->count - 1) / from->count;
+  unsigned __int128 hi = (((unsigned __int128)(i + 1) << 64) + from->count - 1) / from->count - 1;
+  return ((lo * tt->count) >> 64) != ((hi * tt->count) >> 64);
+}
+
+// Fill a slice of the new table from the old one. The multiply-high index is monotone
+// in the hash, so the hashes landing in new bucket j came from a contiguous run of old
+// buckets. Their entries are the only candidates for j, and the best BUCKET_SIZE of them
+// are kept.
+// When growing, an old bucket feeds several new ones, and which of them an entry belongs
+// to is lost: the index comes from the high bits of the hash, the entry only keeps the low
+// ones. It is copied into each of them so it can still be found, but aged half the age
+// cycle back. The copy that gets probed is refreshed by the hit, the others are the first
+// to be replaced, whatever their depth.
+void* TTRehashPart(void* arg) {
+  TTJob* job = (TTJob*)arg;
+  TTTable* tt = job->tt;
+  TTTable* from = job->from;
+
+  uint64_t start, end;
+  TTJobSlice(job, &start, &end);
+
+  for (uint64_t j = start / sizeof(TTBucket); j < end / sizeof(TTBucket); j++) {
+    // first and last hash indexing bucket j, then the old buckets those came from
+    unsigned __int128 lo = (((unsigned __int128)j << 64) + tt->count - 1) / tt->count;
+    unsigned __int128 hi = (((unsigned __int128)(j + 1) << 64) + tt->count - 1) / tt->count - 1;
+    uint64_t first = (lo * from->count) >> 64;
+    uint64_t last = (hi * from->count) >> 64;
+
+    TTEntry* keep[BUCKET_SIZE];
+    int values[BUCKET_SIZE], spread[BUCKET_SIZE];
+    int n = 0;
+
+    for (uint64_t i = first; i <= last; i++) {
+      int spreads = TTSpreads(tt, from, i);
+
+      for (int s = 0; s < BUCKET_SIZE; s++) {
+        TTEntry* entry = &from->buckets[i].entries[s];
+        TTData e;
+        if (!TTRead(entry, &e) && TTEmpty(&e))
+          continue;
+
+        // insertion into the kept entries, best first, a spread copy never counts as current
+        int value = spreads ? e.depth + 128 : TTKeepValue(tt, &e);
+        if (n == BUCKET_SIZE && value <= values[n - 1])
+          continue;
+
+        int k = n < BUCKET_SIZE ? n++ : n - 1;
+        for (; k > 0 && values[k - 1] < value; k--) {
+          keep[k] = keep[k - 1];
+          values[k] = values[k - 1];
+          spread[k] = spread[k - 1];
+        }
+        keep[k] = entry;
+        values[k] = value;
+        spread[k] = spreads;
+      }
     }
 
+    // raw copies, the hash check doesn't depend on the bucket
+    TTBucket* bucket = &tt->buckets[j];
+    memset(bucket, 0, sizeof(TTBucket));
+    for (int k = 0; k < n; k++) {
+      bucket->entries[k] = *keep[k];
+      if (spread[k])
+        TTTouch(&bucket->entries[k], (tt->age - (TT_AGE_MASK + 1) / 2) & TT_AGE_MASK);
+    }
+  }
+
   return NULL;
 }
 
-inline void TTPut(uint64_t hash, int8_t depth, int16_t score, uint8_t flag, Move move, int ply, int16_t eval) {
-  TTBucket* bucket = &TT.buckets[TT.mask & hash];
-  uint32_t shortHash = hash >> 32;
+// move the entries of a table being replaced into the new one, which is first touched here
+void TTRehash(TTTable* tt, TTTable* from, ThreadData* threads) { TTRunJobs(&TTRehashPart, tt, from, threads); }
+
+#ifdef TT_STATS
+// the full hash last written to a slot, 0 when unknown (always, when collisions are not tracked)
+INLINE uint64_t TTSlotHash(TTTable* tt, uint64_t hash, int slot) {
+  return tt->hashes ? tt->hashes[TTIndex(tt, hash) * BUCKET_SIZE + slot] : 0;
+}
+
+INLINE void TTSetSlotHash(TTTable* tt, uint64_t hash, int slot) {
+  if (tt->hashes)
+    tt->hashes[TTIndex(tt, hash) * BUCKET_SIZE + slot] = hash;
+}
+#endif
+
+inline int TTProbe(TTTable* tt, TTData* e, uint64_t hash) {
+  TTEntry* bucket = tt->buckets[TTIndex(tt, hash)].entries;
+  uint32_t key = TTKey(hash);
+  TT_STAT(probes);
+
+  for (int i = 0; i < BUCKET_SIZE; i++)
+    if (TTRead(&bucket[i], e) == key) {
+      if (e->age != tt->age)
+        TTTouch(&bucket[i], tt->age);
+
+#ifdef TT_STATS
+      uint64_t slotHash = TTSlotHash(tt, hash, i);
+      if (slotHash && slotHash != hash)
+        TT_STAT(probeCollisions);
+#endif
+
+      TT_STAT(hits);
+      return 1;
+    }
+
+  return 0;
+}
+
+inline void TTPut(TTTable* tt, uint64_t hash, int8_t depth, int16_t score, uint8_t flag, Move move, int ply, int16_t eval) {
+  TTBucket* bucket = &tt->buckets[TTIndex(tt, hash)];
+  uint32_t key = TTKey(hash);
   TTEntry* toReplace = bucket->entries;
+  int replaceValue = INT32_MAX;
 
   if (score > MATE_BOUND)
     score += ply;
@@ -79,38 +856,103 @@ inline void TTPut(uint64_t hash, int8_t depth, int16_t score, uint8_t flag, Move
     score -= ply;
 
   for (TTEntry* entry = bucket->entries; entry < bucket->entries + BUCKET_SIZE; entry++) {
-    if (!entry->hash) {
+    TTData e;
+    uint32_t entryKey = TTRead(entry, &e);
+
+    if (!entryKey && TTEmpty(&e)) {
+      TT_STAT(empties);
       toReplace = entry;
       break;
     }
 
-    if (entry->hash == shortHash) {
-      if (entry->depth > depth * 2 && !(flag & TT_EXACT))
+    if (entryKey == key) {
+#ifdef TT_STATS
+      uint64_t slotHash = TTSlotHash(tt, hash, entry - bucket->entries);
+      if (slotHash && slotHash != hash)
+        TT_STAT(putCollisions);
+#endif
+
+      if (e.depth > depth * 2 && !(flag & TT_EXACT)) {
+        TT_STAT(rejects);
         return;
+      }
 
+      TT_STAT(refreshes);
       toReplace = entry;
       break;
     }
 
-    if (entry->depth - (256 + TT.age - entry->age) * 4 < toReplace->depth - (256 + TT.age - toReplace->age) * 4)
+    int value = e.depth - TTAgeDiff(tt, &e) * 4;
+    if (value < replaceValue) {
       toReplace = entry;
+      replaceValue = value;
+    }
+  }
+
+#ifdef TT_STATS
+  // anything other than an empty slot or the same position is another position's entry going
+  TTData old;
+  uint32_t oldKey = TTRead(toReplace, &old);
+  if (oldKey != key && (oldKey || !TTEmpty(&old))) {
+    if (TTAgeDiff(tt, &old))
+      TT_STAT(staleOverwrites);
+    else
+      TT_STAT(liveOverwrites);
   }
+#endif
+
+  TTData e = {.flags = flag, .depth = depth, .eval = eval, .score = score, .move = move, .age = tt->age};
+  TTWrite(toReplace, key, &e);
+  TT_STAT(writes);
 
-  *toReplace = (TTEntry){
-      .flags = flag, .depth = depth, .eval = eval, .score = score, .hash = shortHash, .move = move, .age = TT.age};
+#ifdef TT_STATS
+  TTSetSlotHash(tt, hash, toReplace - bucket->entries);
+#endif
 }
 
-inline int TTFull() {
-  int c = 1000 / BUCKET_SIZE;
+// Permille of entries written by the current search, from a sample of buckets spread
+// evenly over the whole table. Info lines come often, so the estimate is kept for
+// TT_FULL_INTERVAL ms and only resampled once it is stale or the age has moved on.
+int TTFull(TTTable* tt) {
+  long now = GetTimeMS();
+  if (tt->fullAge == tt->age && now - tt->fullTime < TT_FULL_INTERVAL)
+    return tt->full;
+
+  uint64_t samples = min(tt->count, TT_FULL_SAMPLES);
   int t = 0;
 
-  for (int i = 0; i < c; i++) {
-    TTBucket b = TT.buckets[i];
+  for (uint64_t i = 0; i < samples; i++) {
+    TTEntry* bucket = tt->buckets[i * tt->count / samples].entries;
+
     for (int j = 0; j < BUCKET_SIZE; j++) {
-      if (b.entries[j].hash && b.entries[j].age == TT.age)
+      TTData e;
+      uint32_t key = TTRead(&bucket[j], &e);
+      if ((key || !TTEmpty(&e)) && e.age == tt->age)
         t++;
     }
   }
 
-  return t * 1000 / (c * BUCKET_SIZE);
-}
\ No newline at end of file
+  tt->full = t * 1000 / (samples * BUCKET_SIZE);
+  tt->fullTime = now;
+  tt->fullAge = tt->age;
+  return tt->full;
+}
+#ifdef TT_STATS
+void TTAddStats(TTStats* total, TTStats* stats) {
+  // every field is a uint64_t counter
+  for (size_t i = 0; i < sizeof(TTStats) / sizeof(uint64_t); i++)
+    ((uint64_t*)total)[i] += ((uint64_t*)stats)[i];
+}
+
+void TTPrintStats(TTStats* s, char* who) {
+  double probes = s->probes ? s->probes : 1, writes = s->writes ? s->writes : 1;
+
+  printf("info string tt %s probes %" PRIu64 " hits %" PRIu64 " (%.1f%%) cutoffs %" PRIu64 " (%.1f%%) collisions %" PRIu64
+         "\n",
+         who, s->probes, s->hits, 100 * s->hits / probes, s->cutoffs, 100 * s->cutoffs / probes, s->probeCollisions);
+  printf("info string tt %s writes %" PRIu64 " empty %.1f%% same %.1f%% stale %.1f%% live %.1f%% rejects %" PRIu64
+         " collisions %" PRIu64 "\n",
+         who, s->writes, 100 * s->empties / writes, 100 * s->refreshes / writes, 100 * s->staleOverwrites / writes,
+         100 * s->liveOverwrites / writes, s->rejects, s->putCollisions);
+}
+#endif
@@ -1,5 +1,3 @@
-
-
 #ifndef TRANSPOSITION_H
 #define TRANSPOSITION_H
 
@@ -7,38 +5,124 @@
 
 #define NO_ENTRY 0ULL
 #define MEGABYTE 0x100000ULL
-#define BUCKET_SIZE 4
+#define TT_MAX_MB 65536 // largest Hash the option allows, loadhash refuses bigger files
+
+#define TT_FULL_SAMPLES 2048ULL // buckets sampled for hashfull
+#define TT_FULL_INTERVAL 100    // ms an estimate is reused for
 
+#ifdef TT_PACKED
+#define BUCKET_SIZE 3
+#define TT_AGE_MASK 0x1F
+
+// 10 byte entries, three to a 32 byte bucket. The key is the hash check xor'd with a
+// fold of the other fields (the age is left out so it can be refreshed in place),
+// and the move is kept in a 16 bit form that TTMove expands against the board.
 typedef struct {
-  uint32_t hash, move;
-  int16_t eval, score;
+  uint16_t key;
+  uint16_t move; // from (6) | to (6) | promotion type (2) | promotion/castle (2)
+  int16_t score, eval;
   int8_t depth;
-  uint8_t flags, age;
+  uint8_t ageFlags; // age (5) | flags (3)
+} TTEntry;
+
+typedef struct {
+  TTEntry entries[BUCKET_SIZE];
+  uint16_t padding;
+} TTBucket;
+#else
+#define BUCKET_SIZE 4
+#define TT_AGE_MASK 0xFF
+
+// An entry is two 64 bit words, each written with a single store. The key word
+// holds the hash check xor'd with a fold of the data word, so a pair torn apart
+// by two threads writing the same slot fails verification and reads as a miss.
+typedef struct {
+  uint64_t key;  // hash check (32) | depth (8) | flags (8) | age (8)
+  uint64_t data; // move (32) | score (16) | eval (16)
 } TTEntry;
 
 typedef struct {
   TTEntry entries[BUCKET_SIZE];
 } TTBucket;
+#endif
+
+// Saved tables and HashFile mappings start with this header, the buckets follow
+// at TT_FILE_HEADER so a mapped table stays page aligned
+#define TT_FILE_MAGIC 0x3154544B53524542ULL // "BERSKTT1"
+#define TT_FILE_HEADER 4096
+
+typedef struct {
+  uint64_t magic;
+  uint32_t entrySize, bucketSize; // reject files written by the other entry format
+  uint64_t count;
+  uint8_t age;
+} TTFileHeader;
+
+enum { TT_MEM_HEAP, TT_MEM_FILE, TT_MEM_HUGETLB, TT_MEM_SHARED };
+
+// the pages the table actually got, as reported back to the user
+enum { TT_PAGES_NORMAL, TT_PAGES_THP, TT_PAGES_2MB, TT_PAGES_1GB };
 
 typedef struct {
   TTBucket* buckets;
-  uint64_t mask;
-  uint64_t size;
+  uint64_t count; // number of buckets
+  uint64_t size;  // bytes in use
   uint8_t age;
+  int mem;              // how the buckets were allocated
+  int pages;            // page size backing the buckets
+  uint64_t mapped;      // length of the mapping for mmap'd tables
+  TTFileHeader* header; // start of the mapping for file backed and shared tables
+  char file[1024];      // HashFile, the table is mapped from it when set
+  char shm[256];        // SharedHash, a POSIX shared memory name taking precedence over the file
+  int fd;               // the shared memory object, held open (and flocked) while attached
+
+  int full;        // last hashfull estimate
+  long fullTime;   // when it was sampled
+  uint8_t fullAge; // and for which age
+  int requireLargePages; // a heap table must be on large pages, turned off when it cannot be
+#ifdef TT_STATS
+  uint64_t* hashes; // full hash per slot, to tell key collisions from real hits
+#endif
 } TTTable;
 
+// A verified copy of an entry, taken at probe time
+typedef struct {
+  Move move; // compact in TT_PACKED builds, use TTMove for the full move
+  int16_t eval, score;
+  int8_t depth;
+  uint8_t flags, age;
+} TTData;
+
 enum { TT_UNKNOWN = 0, TT_LOWER = 1, TT_UPPER = 2, TT_EXACT = 4 };
 
-extern TTTable TT;
+// threads is the pool that clears or rehashes the table, NULL to do it on the calling thread
+size_t TTInit(TTTable* tt, int mb, ThreadData* threads);
+void TTFree(TTTable* tt);
+void TTClear(TTTable* tt, ThreadData* threads);
+void TTUpdate(TTTable* tt);
+void TTPrefetch(TTTable* tt, uint64_t hash);
+int TTProbe(TTTable* tt, TTData* e, uint64_t hash);
+int TTScore(TTData* e, int ply);
+Move TTMove(TTData* e, Board* board);
+void TTPut(TTTable* tt, uint64_t hash, int8_t depth, int16_t score, uint8_t flag, Move move, int ply, int16_t eval);
+int TTFull(TTTable* tt);
+const char* TTPagesName(TTTable* tt);
+
+#ifdef TT_STATS
+// counters go to whichever thread bound its stats, probes from unbound threads are not counted
+extern __thread TTStats* ttStats;
+#define TT_STAT(field)                                                                                                 \
+  do {                                                                                                                 \
+    if (ttStats)                                                                                                       \
+      ttStats->field++;                                                                                                \
+  } while (0)
 
-size_t TTInit(int mb);
-void TTFree();
-void TTClear();
-void TTUpdate();
-void TTPrefetch(uint64_t hash);
-TTEntry* TTProbe(int* hit, uint64_t hash);
-int TTScore(TTEntry* e, int ply);
-void TTPut(uint64_t hash, int8_t depth, int16_t score, uint8_t flag, Move move, int ply, int16_t eval);
-int TTFull();
+void TTAddStats(TTStats* total, TTStats* stats);
+void TTPrintStats(TTStats* stats, char* who);
+#else
+#define TT_STAT(field)
+#endif
+int TTSave(TTTable* tt, char* path);
+int TTLoad(TTTable* tt, char* path, ThreadData* threads);
 
-#endif
\ No newline at end of file
+#endif
@@ -1164,7 +1164,7 @@ Position* LoadPositions(int* n, Weights* weights) {
 
   EvalGradientData ks;
   Board board;
-  ThreadData* threads = CreatePool(1);
+  ThreadData* threads = CreatePool(NULL, 1, 0);
 
   char buffer[128];
 
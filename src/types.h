@@ -4,7 +4,7 @@
 #define TYPES_H
 
 #include <inttypes.h>
-#include <setjmp.h>
+#include <pthread.h>
 
 #ifdef TUNE
 #define MAX_SEARCH_PLY 16
@@ -24,6 +24,8 @@
 #define PAWN_TABLE_SIZE (1ULL << 16)
 #endif
 
+#define CACHE_LINE 64
+
 typedef int Score;
 
 typedef uint64_t BitBoard;
@@ -52,7 +54,8 @@ typedef struct {
 
   int castlingRights[64];
   int castleRooks[4];
-  
+  int chess960; // castles are printed as the king taking its rook
+
   // data that is hard to track, so it is "remembered" when search undoes moves
   int castlingHistory[MAX_GAME_PLY];
   int epSquareHistory[MAX_GAME_PLY];
@@ -76,23 +79,43 @@ typedef struct {
   Move moves[MAX_SEARCH_PLY];
 } PV;
 
+// Per ply search state, laid out together so a node touches one entry rather than
+// an array per field. A node works on ss = &data->stack[data->ply + STACK_OFFSET]
+// and reads its ancestors through ss - 1 and ss - 2, the entries before the root
+// stay empty so those are always valid.
+#define STACK_OFFSET 2
+#define STACK_SIZE (MAX_SEARCH_PLY + STACK_OFFSET + 2)
+
+typedef struct {
+  Move move;       // move played from this ply
+  Move skipMove;   // move to skip during singular search
+  int eval;        // static eval
+  int inCheck;     // side to move is in check
+  Move killers[2]; // killer moves, 2 per ply
+  int (*ch)[64];   // counter move history slice for the replies to move, NULL after a null move
+  int (*fh)[64];   // follow up history slice for the moves two plies on
+} SearchStack;
+
 // A general data object for use during search
 typedef struct {
   Score contempt;
 
   Board* board; // reference to board
-  int ply;      // ply depth of active search
 
-  // TODO: Put depth here as well? Just cause
-  uint64_t nodes; // node count
+  // written on every node and summed by the main thread for info output,
+  // kept on a line of their own so those reads only ever miss on this one
+  _Alignas(CACHE_LINE) uint64_t nodes; // node count
+  uint64_t nextCheck;                  // node count the limits are checked at next, see StopSearch
   uint64_t tbhits;
   int seldepth; // seldepth count
+  int ply;      // ply depth of active search
 
-  Move skipMove[MAX_SEARCH_PLY]; // moves to skip during singular search
-  int evals[MAX_SEARCH_PLY];     // static evals at ply stack
-  Move moves[MAX_SEARCH_PLY];    // moves for ply stack
+  _Alignas(CACHE_LINE) SearchStack stack[STACK_SIZE];
+
+  // triangular pv table, the pv of the node at ply is in row ply (one row past the last
+  // ply for the children of nodes there)
+  PV pvTable[MAX_SEARCH_PLY + 1];
 
-  Move killers[MAX_SEARCH_PLY][2]; // killer moves, 2 per ply
   Move counters[64 * 64];          // counter move butterfly table
   int hh[2][64 * 64];              // history heuristic butterfly table (side)
   int ch[6][64][6][64];            // counter move history table
@@ -187,24 +210,36 @@ typedef struct {
 
 typedef struct {
   long start;
-  int alloc;
-  int max;
+  int softLimit; // no depth is started past this, scaled during the search (timeman.c)
+  int hardLimit; // every thread stops here
 
   int timeset;
   int depth;
-  int movesToGo;
-  int stopped;
+  uint64_t nodes; // summed over all threads, 0 for none
+  int mate;       // in moves, 0 for none
+  int stopped; // atomic, see Stopped in search.c
   int quit;
   int multiPV;
+  int quiet; // no uci output, for batch analysis
   int searchMoves;
   SimpleMoveList searchable;
 } SearchParams;
 
+typedef struct {
+  Move move;
+  int score;         // of the last search at the root, -UNKNOWN unless it was exact or a bound past alpha
+  int previousScore; // as of the previous iteration, breaks ties when sorting
+  uint64_t nodes;    // spent below this move over the whole search
+} RootMove;
+
 typedef struct {
   int depth;
   Score scores[MAX_SEARCH_PLY];
   Move bestMoves[MAX_SEARCH_PLY];
   Move ponderMoves[MAX_SEARCH_PLY];
+  int searching[MAX_SEARCH_PLY]; // threads currently on each depth (atomic)
+  Move bestMove;                 // the move played, once the search is over
+  int score;                     // with the score of the thread it was taken from
 } SearchResults;
 
 typedef struct {
@@ -230,32 +265,63 @@ typedef struct {
   BitBoard passedPawns;
 } PawnHashEntry;
 
+#ifdef TT_STATS
+// Transposition table counters for one thread, only in TT_STATS builds
+typedef struct {
+  uint64_t probes, hits, cutoffs;
+  uint64_t writes, empties, refreshes, staleOverwrites, liveOverwrites, rejects;
+  uint64_t probeCollisions, putCollisions; // check matched but the full hash did not
+} TTStats;
+#endif
+
 typedef struct ThreadData ThreadData;
+typedef struct Engine Engine;
 
+// Laid out so nothing one thread writes during a search shares a cache line with
+// what another thread reads: the shared pointers are only set between searches,
+// the worker state is only touched when jobs are handed over, and the counters
+// live at the head of data. The pool itself is CACHE_LINE aligned.
 struct ThreadData {
-  int count, idx, multiPV, depth;
+  // shared, read only while searching
+  _Alignas(CACHE_LINE) int count, idx;
+  Engine* engine;
+  ThreadData* threads;
+  SearchParams* params;
+  SearchResults* results;
+
+  // persistent worker, asleep on wake until handed a job
+  _Alignas(CACHE_LINE) pthread_t nativeThread;
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  void* (*job)(void*);
+  void* jobArg;
+  int exiting;
+
+  _Alignas(CACHE_LINE) int multiPV, depth;
+
+  // the last depth this thread completed, for picking the best thread after a search
+  int completedDepth;
+  Score completedScore;
+  PV completedPv;
 
   Score scores[MAX_MOVES];
   Move bestMoves[MAX_MOVES];
   PV pvs[MAX_MOVES];
 
-  ThreadData* threads;
-  jmp_buf exit;
+  // the legal (and searchable) root moves, best first after each search of the root
+  int numRootMoves;
+  RootMove rootMoves[MAX_MOVES];
 
-  SearchParams* params;
-  SearchResults* results;
   SearchData data;
 
   PawnHashEntry pawnHashTable[PAWN_TABLE_SIZE];
 
   Board board;
-};
 
-typedef struct {
-  Board* board;
-  SearchParams* params;
-  ThreadData* threads;
-} SearchArgs;
+#ifdef TT_STATS
+  TTStats ttStats;
+#endif
+};
 
 // Move generation storage
 // moves/scores idx's match
@@ -277,6 +343,7 @@ enum {
 
 typedef struct {
   SearchData* data;
+  SearchStack* ss;
   Move hashMove, killer1, killer2, counter;
   int seeCutoff;
   uint8_t type, phase, nTactical, nQuiets, nBadTactical;
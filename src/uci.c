@@ -1,21 +1,25 @@
 
 
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "board.h"
+#include "engine.h"
 #include "eval.h"
 #include "move.h"
 #include "movegen.h"
 #include "movepick.h"
 #include "noobprobe/noobprobe.h"
+#include "numa.h"
 #include "perft.h"
 #include "pyrrhic/tbprobe.h"
 #include "search.h"
 #include "see.h"
 #include "thread.h"
+#include "timeman.h"
 #include "transposition.h"
 #include "uci.h"
 #include "util.h"
@@ -25,12 +29,6 @@
 
 #define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
 
-int MOVE_OVERHEAD = 100;
-int MULTI_PV = 1;
-int PONDER_ENABLED = 1;
-int CHESS_960 = 0;
-volatile int PONDERING = 0;
-
 void RootMoves(SimpleMoveList* moves, Board* board) {
   moves->count = 0;
 
@@ -43,19 +41,26 @@ void RootMoves(SimpleMoveList* moves, Board* board) {
 }
 
 // uci "go" command
-void ParseGo(char* in, SearchParams* params, Board* board, ThreadData* threads) {
+void ParseGo(char* in, Engine* engine) {
+  SearchParams* params = &engine->params;
+  Board* board = &engine->board;
   in += 3;
 
+  // a stopped search may still be unwinding and reads all of this until it has printed its bestmove
+  WaitJob(engine->threads);
+
   params->depth = MAX_SEARCH_PLY;
   params->start = GetTimeMS();
   params->timeset = 0;
+  params->nodes = 0;
+  params->mate = 0;
   params->stopped = 0;
   params->quit = 0;
-  params->multiPV = MULTI_PV;
+  params->multiPV = engine->multiPV;
   params->searchMoves = 0;
   params->searchable.count = 0;
 
-  PONDERING = 0;
+  SetPondering(engine, 0);
 
   char* ptrChar = in;
   int perft = 0, movesToGo = 30, moveTime = -1, time = -1, inc = 0, depth = -1;
@@ -87,8 +92,14 @@ void ParseGo(char* in, SearchParams* params, Board* board, ThreadData* threads)
   if ((ptrChar = strstr(in, "depth")))
     depth = min(MAX_SEARCH_PLY - 1, atoi(ptrChar + 6));
 
+  if ((ptrChar = strstr(in, "nodes")))
+    params->nodes = max(0, atoll(ptrChar + 6));
+
+  if ((ptrChar = strstr(in, "mate")))
+    params->mate = max(0, atoi(ptrChar + 5));
+
   if ((ptrChar = strstr(in, "ponder")))
-    PONDERING = 1;
+    SetPondering(engine, 1);
 
   if ((ptrChar = strstr(in, "searchmoves"))) {
     params->searchMoves = 1;
@@ -109,18 +120,13 @@ void ParseGo(char* in, SearchParams* params, Board* board, ThreadData* threads)
   // "movetime" is essentially making a move with 1 to go for TC
   if (moveTime != -1) {
     params->timeset = 1;
-    params->alloc = moveTime;
-    params->max = moveTime;
+    params->softLimit = moveTime;
+    params->hardLimit = moveTime;
   } else {
     if (time != -1) {
       params->timeset = 1;
 
-      time = max(0, time - MOVE_OVERHEAD);
-      int spend = time / movesToGo + inc;
-      spend = max(1, spend);
-
-      params->max = min(4 * spend, time * 0.9);
-      params->alloc = min(spend, params->max / 3);
+      TMSetClock(params, max(0, time - engine->moveOverhead), inc, movesToGo);
     } else {
       // no time control
       params->timeset = 0;
@@ -128,29 +134,26 @@ void ParseGo(char* in, SearchParams* params, Board* board, ThreadData* threads)
   }
 
   params->multiPV = min(params->multiPV, params->searchMoves ? params->searchable.count : rootMoves.count);
-  if (rootMoves.count == 1 && params->timeset)
-    params->max = min(250, params->max);
+  // a forced move is played after the first depth
+  if (rootMoves.count == 1 && params->timeset) {
+    params->softLimit = 0;
+    params->hardLimit = min(250, params->hardLimit);
+  }
 
   if (depth <= 0)
     params->depth = MAX_SEARCH_PLY - 1;
 
-  printf("info string time %d start %ld alloc %d max %d depth %d timeset %d searchmoves %d\n", time, params->start,
-         params->alloc, params->max, params->depth, params->timeset, params->searchable.count);
-
-  // this MUST be freed from within the search, or else massive leak
-  SearchArgs* args = malloc(sizeof(SearchArgs));
-  args->board = board;
-  args->params = params;
-  args->threads = threads;
+  printf("info string time %d start %ld soft %d hard %d depth %d timeset %d nodes %" PRIu64 " mate %d searchmoves %d\n",
+         time, params->start, params->softLimit, params->hardLimit, params->depth, params->timeset, params->nodes,
+         params->mate, params->searchable.count);
 
-  // start the search!
-  pthread_t searchThread;
-  pthread_create(&searchThread, NULL, &UCISearch, args);
-  pthread_detach(searchThread);
+  // start the search on the main thread's worker
+  StartJob(engine->threads, &UCISearch, engine);
 }
 
 // uci "position" command
-void ParsePosition(char* in, Board* board) {
+void ParsePosition(char* in, Engine* engine) {
+  Board* board = &engine->board;
   in += 9;
   char* ptrChar = in;
 
@@ -166,6 +169,13 @@ void ParsePosition(char* in, Board* board) {
     }
   }
 
+  // a 960 position turns the option on, in case the gui didn't
+  if (board->chess960 && !engine->chess960) {
+    engine->chess960 = 1;
+    printf("info string set UCI_Chess960 to value true\n");
+  }
+  board->chess960 = engine->chess960;
+
   ptrChar = strstr(in, "moves");
 
   if (ptrChar == NULL)
@@ -185,8 +195,12 @@ void ParsePosition(char* in, Board* board) {
 void PrintUCIOptions() {
   printf("id name " NAME " " VERSION "\n");
   printf("id author Jay Honnold\n");
-  printf("option name Hash type spin default 32 min 4 max 65536\n");
+  printf("option name Hash type spin default 32 min 4 max " stringize(TT_MAX_MB) "\n");
+  printf("option name HashFile type string default <empty>\n");
+  printf("option name SharedHash type string default <empty>\n");
+  printf("option name RequireLargePages type check default false\n");
   printf("option name Threads type spin default 1 min 1 max 256\n");
+  printf("option name NUMA type check default true\n");
   printf("option name NoobBookLimit type spin default 8 min 0 max 32\n");
   printf("option name NoobBook type check default false\n");
   printf("option name SyzygyPath type string default <empty>\n");
@@ -210,11 +224,9 @@ int ReadLine(char* in) {
 void UCILoop() {
   static char in[8192];
 
-  Board board;
-  ParseFen(START_FEN, &board);
-
-  ThreadData* threads = CreatePool(1);
-  SearchParams searchParameters = {.quit = 0};
+  Engine* engine = CreateEngine(32, 1);
+  Board* board = &engine->board;
+  ParsePosition("position startpos", engine);
 
   setbuf(stdin, NULL);
   setbuf(stdout, NULL);
@@ -223,61 +235,128 @@ void UCILoop() {
     if (in[0] == '\n')
       continue;
 
+    // these change the table, the pool or the game a search works with, so a search still running
+    // (an infinite one the GUI did not stop) is ended first rather than raced or waited on forever
+    if (!strncmp(in, "ucinewgame", 10) || !strncmp(in, "setoption", 9) || !strncmp(in, "savehash", 8) ||
+        !strncmp(in, "loadhash", 8))
+      StopEngine(engine);
+
     if (!strncmp(in, "isready", 7)) {
       printf("readyok\n");
     } else if (!strncmp(in, "position", 8)) {
-      ParsePosition(in, &board);
+      ParsePosition(in, engine);
     } else if (!strncmp(in, "ucinewgame", 10)) {
-      ParsePosition("position startpos\n", &board);
-      TTClear();
-      ResetThreadPool(threads);
+      ParsePosition("position startpos\n", engine);
+      NewGame(engine);
       failedQueries = 0;
     } else if (!strncmp(in, "go", 2)) {
-      ParseGo(in, &searchParameters, &board, threads);
+      ParseGo(in, engine);
     } else if (!strncmp(in, "stop", 4)) {
-      PONDERING = 0;
-      searchParameters.stopped = 1;
+      SetPondering(engine, 0);
+      __atomic_store_n(&engine->params.stopped, 1, __ATOMIC_RELAXED);
     } else if (!strncmp(in, "quit", 4)) {
-      PONDERING = 0;
-      searchParameters.quit = 1;
+      engine->params.quit = 1;
       break;
     } else if (!strncmp(in, "uci", 3)) {
       PrintUCIOptions();
     } else if (!strncmp(in, "ponderhit", 9)) {
-      PONDERING = 0;
+      SetPondering(engine, 0);
     } else if (!strncmp(in, "board", 5)) {
-      PrintBoard(&board);
+      PrintBoard(board);
     } else if (!strncmp(in, "eval", 4)) {
-      Score s = Evaluate(&board, &threads[0]);
-      if (board.side == BLACK)
+      Score s = Evaluate(board, engine->threads);
+      if (board->side == BLACK)
         s = -s;
 
       printf("Score: %dcp (white)\n", s);
     } else if (!strncmp(in, "moves", 5)) {
-      PrintMoves(&board, threads);
+      PrintMoves(board, engine->threads);
     } else if (!strncmp(in, "see ", 4)) {
-      Move m = ParseMove(in + 4, &board);
+      Move m = ParseMove(in + 4, board);
       if (m)
-        printf("info string SEE result: %d\n", SEE(&board, m));
+        printf("info string SEE result: %d\n", SEE(board, m));
       else
         printf("info string Invalid move!\n");
     } else if (!strncmp(in, "apply ", 6)) {
-      Move m = ParseMove(in + 6, &board);
+      Move m = ParseMove(in + 6, board);
       if (m) {
-        MakeMove(m, &board);
-        PrintBoard(&board);
+        MakeMove(m, board);
+        PrintBoard(board);
       } else
         printf("info string Invalid move!\n");
     } else if (!strncmp(in, "setoption name Hash value ", 26)) {
       int mb = GetOptionIntValue(in);
-      mb = max(4, min(65536, mb));
-      size_t bytesAllocated = TTInit(mb);
-      printf("info string set Hash to value %d (%zu bytes)\n", mb, bytesAllocated);
+      mb = max(4, min(TT_MAX_MB, mb));
+      size_t bytesAllocated = TTInit(&engine->tt, mb, engine->threads);
+      printf("info string set Hash to value %d (%zu bytes, %s)\n", mb, bytesAllocated, TTPagesName(&engine->tt));
+    } else if (!strncmp(in, "setoption name HashFile value", 29)) {
+      char* path = in + 29;
+      while (*path == ' ')
+        path++;
+
+      if (!strcmp(path, "<empty>"))
+        path = "";
+
+      if (strlen(path) >= sizeof(engine->tt.file)) {
+        printf("info string HashFile path is too long\n");
+        continue;
+      }
+
+      strcpy(engine->tt.file, path);
+      size_t bytesAllocated = TTInit(&engine->tt, engine->tt.size / MEGABYTE, engine->threads);
+      printf("info string set HashFile to value %s (%zu bytes)\n", engine->tt.mem == TT_MEM_FILE ? engine->tt.file : "<empty>",
+             bytesAllocated);
+    } else if (!strncmp(in, "setoption name SharedHash value", 31)) {
+      char* name = in + 31;
+      while (*name == ' ' || *name == '/')
+        name++;
+
+      if (!strcmp(name, "<empty>"))
+        name = "";
+
+      // POSIX shared memory names are a single leading slash and no others
+      char shm[sizeof(engine->tt.shm)];
+      if (snprintf(shm, sizeof(shm), *name ? "/%s" : "%s", name) >= (int)sizeof(shm)) {
+        printf("info string SharedHash name is too long\n");
+        continue;
+      }
+
+      strcpy(engine->tt.shm, shm);
+
+      size_t bytesAllocated = TTInit(&engine->tt, engine->tt.size / MEGABYTE, engine->threads);
+      printf("info string set SharedHash to value %s (%zu bytes)\n", engine->tt.mem == TT_MEM_SHARED ? engine->tt.shm + 1 : "<empty>",
+             bytesAllocated);
+    } else if (!strncmp(in, "setoption name RequireLargePages value ", 39)) {
+      char opt[5];
+      sscanf(in, "%*s %*s %*s %*s %5s", opt);
+
+      engine->tt.requireLargePages = !strncmp(opt, "true", 4);
+      size_t bytesAllocated = TTInit(&engine->tt, engine->tt.size / MEGABYTE, engine->threads);
+      printf("info string set RequireLargePages to value %s (%zu bytes, %s)\n",
+             engine->tt.requireLargePages ? "true" : "false", bytesAllocated, TTPagesName(&engine->tt));
+    } else if (!strncmp(in, "savehash ", 9)) {
+      if (TTSave(&engine->tt, in + 9))
+        printf("info string saved hash to %s\n", in + 9);
+      else
+        printf("info string failed to save hash to %s\n", in + 9);
+    } else if (!strncmp(in, "loadhash ", 9)) {
+      if (TTLoad(&engine->tt, in + 9, engine->threads))
+        printf("info string loaded hash from %s (%zu bytes)\n", in + 9, (size_t)engine->tt.size);
+      else
+        printf("info string failed to load hash from %s\n", in + 9);
     } else if (!strncmp(in, "setoption name Threads value ", 29)) {
       int n = GetOptionIntValue(in);
-      free(threads);
-      threads = CreatePool(max(1, min(256, n)));
+      SetThreads(engine, max(1, min(256, n)));
       printf("info string set Threads to value %d\n", n);
+    } else if (!strncmp(in, "setoption name NUMA value ", 26)) {
+      char opt[5];
+      sscanf(in, "%*s %*s %*s %*s %5s", opt);
+
+      // rebuild the pool and table so placement follows the new setting
+      NUMA_ENABLED = !strncmp(opt, "true", 4);
+      SetThreads(engine, engine->threads->count);
+      TTInit(&engine->tt, engine->tt.size / MEGABYTE, engine->threads);
+      printf("info string set NUMA to value %s (%d nodes)\n", NUMA_ENABLED ? "true" : "false", NumaNodes());
     } else if (!strncmp(in, "setoption name SyzygyPath value ", 32)) {
       int success = tb_init(in + 32);
       if (success)
@@ -296,22 +375,25 @@ void UCILoop() {
     } else if (!strncmp(in, "setoption name MultiPV value ", 29)) {
       int n = GetOptionIntValue(in);
 
-      MULTI_PV = max(1, min(256, n));
-      printf("info string set MultiPV to value %d\n", MULTI_PV);
+      engine->multiPV = max(1, min(256, n));
+      printf("info string set MultiPV to value %d\n", engine->multiPV);
     } else if (!strncmp(in, "setoption name Ponder value ", 28)) {
       char opt[5];
       sscanf(in, "%*s %*s %*s %*s %5s", opt);
 
-      PONDER_ENABLED = !strncmp(opt, "true", 4);
-      printf("info string set Ponder to value %s\n", PONDER_ENABLED ? "true" : "false");
+      engine->ponderEnabled = !strncmp(opt, "true", 4);
+      printf("info string set Ponder to value %s\n", engine->ponderEnabled ? "true" : "false");
     } else if (!strncmp(in, "setoption name UCI_Chess960 value ", 34)) {
       char opt[5];
       sscanf(in, "%*s %*s %*s %*s %5s", opt);
 
-      CHESS_960 = !strncmp(opt, "true", 4);
-      printf("info string set UCI_Chess960 to value %s\n", CHESS_960 ? "true" : "false");
+      engine->chess960 = board->chess960 = !strncmp(opt, "true", 4);
+      printf("info string set UCI_Chess960 to value %s\n", engine->chess960 ? "true" : "false");
     }
   }
+
+  // stops a search still running, and detaches from a SharedHash segment
+  DestroyEngine(engine);
 }
 
 int GetOptionIntValue(char* in) {
@@ -0,0 +1,150 @@
+// Hammers a deliberately tiny transposition table from several threads and counts
+// torn entries. Every payload is derived from the index of its key, so each slot can
+// be checked independently: a key word paired with another write's data word must be
+// rejected (a detected tear), and TTProbe must never hand back a mismatched payload.
+//
+// build: cd src && make ttstress (add -DTT_PACKED to DFLAGS for the packed format)
+// usage: ../tests/ttstress [threads] [seconds]
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/transposition.c"
+
+#define STRESS_KEYS 4096
+#define STRESS_BUCKETS 8
+
+static TTTable table;
+
+// a check of this many bits lets one in 2^n comparisons against a torn slot through
+#ifdef TT_PACKED
+#define CHECK_BITS 16
+#else
+#define CHECK_BITS 32
+#endif
+
+typedef struct {
+  pthread_t thread;
+  uint64_t seed;
+  uint64_t writes, probes, hits, tears, corrupt;
+} Worker;
+
+static uint64_t keys[STRESS_KEYS];
+static volatile int stop = 0;
+
+static uint64_t Next(uint64_t* seed) {
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 7;
+  *seed ^= *seed << 17;
+  return *seed;
+}
+
+static void Expected(int i, TTData* e) {
+  e->move = i + 1;
+  e->score = (int16_t)(i * 7 - 14000);
+  e->eval = (int16_t)(i * 3 - 6000);
+  e->depth = (int8_t)(i % 100);
+  e->flags = TT_EXACT;
+}
+
+static int Matches(int i, TTData* e) {
+  TTData x;
+  Expected(i, &x);
+
+  return e->move == x.move && e->score == x.score && e->eval == x.eval && e->depth == x.depth && e->flags == x.flags;
+}
+
+// look at the raw slots, without going through TTProbe
+static void Scan(Worker* w) {
+  for (int b = 0; b < STRESS_BUCKETS; b++) {
+    for (int j = 0; j < BUCKET_SIZE; j++) {
+      TTData e;
+      uint32_t check = TTRead(&table.buckets[b].entries[j], &e);
+      if (!check && TTEmpty(&e))
+        continue;
+
+      int i = (int)e.move - 1;
+      if (i < 0 || i >= STRESS_KEYS || check != TTKey(keys[i]))
+        w->tears++;
+      else if (!Matches(i, &e))
+        w->corrupt++;
+    }
+  }
+}
+
+static void* Hammer(void* arg) {
+  Worker* w = arg;
+
+  while (!stop) {
+    uint64_t r = Next(&w->seed);
+    int i = (r >> 32) % STRESS_KEYS;
+    TTData e;
+    Expected(i, &e);
+
+    switch (r & 3) {
+    case 0:
+    case 1:
+      TTPut(&table, keys[i], e.depth, e.score, e.flags, e.move, 0, e.eval);
+      w->writes++;
+      break;
+    case 2:
+      w->probes++;
+      if (TTProbe(&table, &e, keys[i])) {
+        w->hits++;
+        if (!Matches(i, &e))
+          w->corrupt++;
+      }
+      break;
+    default:
+      Scan(w);
+    }
+  }
+
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  int n = argc > 1 ? atoi(argv[1]) : 8;
+  int seconds = argc > 2 ? atoi(argv[2]) : 2;
+  n = max(1, n);
+
+  // the low bits are the hash check (16 of them for packed entries), an odd
+  // multiplier keeps them distinct for every key in both formats
+  for (int i = 0; i < STRESS_KEYS; i++) {
+    uint64_t check = (uint16_t)(i * 40503u);
+    keys[i] = (uint64_t)((uint32_t)i * 2654435761u) << 32 | check << 16 | check;
+  }
+
+  TTInit(&table, 1, NULL);
+  table.count = STRESS_BUCKETS;
+
+  Worker* workers = calloc(n, sizeof(Worker));
+  for (int t = 0; t < n; t++) {
+    workers[t].seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+    pthread_create(&workers[t].thread, NULL, Hammer, &workers[t]);
+  }
+
+  sleep(seconds);
+  stop = 1;
+
+  Worker total = {0};
+  for (int t = 0; t < n; t++) {
+    pthread_join(workers[t].thread, NULL);
+    total.writes += workers[t].writes;
+    total.probes += workers[t].probes;
+    total.hits += workers[t].hits;
+    total.tears += workers[t].tears;
+    total.corrupt += workers[t].corrupt;
+  }
+
+  printf("threads %d writes %" PRIu64 " probes %" PRIu64 " hits %" PRIu64 " detected tears %" PRIu64
+         " undetected %" PRIu64 "\n",
+         n, total.writes, total.probes, total.hits, total.tears, total.corrupt);
+
+  free(workers);
+  TTFree(&table);
+
+  return total.corrupt > (total.probes * BUCKET_SIZE >> CHECK_BITS) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,35 @@
+#!/bin/bash
+# uci protocol regressions, run from the repository root after building src/Clion
+
+error() {
+  echo "uci testing failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+# sends each argument as one batch of commands, half a second apart, and prints the
+# engine's answers (a hung engine is killed after 10 seconds)
+uci() {
+  for batch in "$@"; do
+    printf "$batch\n"
+    sleep 0.5
+  done | timeout 10 ./src/Clion
+}
+
+echo "uci testing started"
+
+# a stop arriving with the go, before the search has started, is not lost
+[ $(uci "go infinite\nstop" "quit" | grep -c "^bestmove") -eq 1 ]
+
+# a go arriving with the stop of the previous search waits for it to unwind
+[ $(uci "go infinite" "stop\ngo infinite" "stop" "quit" | grep -c "^bestmove") -eq 2 ]
+
+# a node budget too small for the first depth still plays a legal move
+[ $(uci "go nodes 1" "quit" | grep -c "^bestmove [a-h][1-8][a-h][1-8]") -eq 1 ]
+[ $(uci "go nodes 1" "quit" | grep -c "^bestmove a8a8") -eq 0 ]
+
+# a table or pool change during an infinite search ends that search instead of hanging
+[ $(uci "go infinite" "setoption name Hash value 8" "quit" | grep -c "^bestmove") -eq 1 ]
+[ $(uci "go infinite" "setoption name Threads value 2" "ucinewgame" "go infinite" "stop" "quit" | grep -c "^bestmove") -eq 2 ]
+
+echo "uci testing OK"